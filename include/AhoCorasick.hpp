@@ -0,0 +1,60 @@
+//AhoCorasick.hpp
+#pragma once
+#ifndef AhoCorasick_HEADER
+#define AhoCorasick_HEADER
+
+//C++
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <queue>
+#include <cstdint>
+#include <cstddef>
+
+/*
+Search for many patterns in one pass.
+The automaton is built as a full transition table (256 entries per state)
+so each input byte is one table lookup, failure links are resolved at build
+time.
+Caseless search folds ASCII letters like SubstringSearcher.
+*/
+class AhoCorasick
+{
+public:
+	AhoCorasick(const std::vector<std::string_view> & patterns, bool caseless);
+
+	std::size_t getNumberOfPatterns() const;
+
+	/*
+	Add occurrences of each pattern in text to counts[pattern index].
+	Overlapping occurrences are counted, empty patterns are never counted.
+	counts must have getNumberOfPatterns() elements.
+	*/
+	void count(std::string_view text, std::vector<std::size_t> & counts) const;
+
+	/*
+	Check if any pattern occurs in text.
+	*/
+	bool containsAny(std::string_view text) const;
+
+private:
+	using State = std::uint32_t;
+
+	static constexpr std::size_t alphabet_size = 256;
+
+	unsigned char foldByte(char c) const
+	{
+		return m_fold[static_cast<unsigned char>(c)];
+	}
+
+	std::size_t m_number_of_patterns;
+	std::array<unsigned char, alphabet_size> m_fold;
+	//m_next[state * alphabet_size + byte]
+	std::vector<State> m_next;
+	//patterns ending in state s are m_outputs[m_output_offsets[s], m_output_offsets[s + 1])
+	std::vector<std::uint32_t> m_output_offsets;
+	std::vector<std::uint32_t> m_outputs;
+};
+
+#endif // !AhoCorasick_HEADER
@@ -0,0 +1,109 @@
+//CaselessPerfectHash.hpp
+#pragma once
+#ifndef CaselessPerfectHash_HEADER
+#define CaselessPerfectHash_HEADER
+
+//C++
+#include <string_view>
+#include <array>
+#include <cstdint>
+#include <cstddef>
+
+/*
+Perfect hash over a fixed set of keys, built at compile time.
+Keys are compared caseless (ASCII).
+Template:
+	N				number of keys
+*/
+template <std::size_t N>
+class CaselessPerfectHash
+{
+public:
+	static constexpr std::size_t npos = N;
+
+	/*
+	Search seeds until every key lands in its own slot.
+	*/
+	constexpr CaselessPerfectHash(const std::array<std::string_view, N> & keys) :
+		m_keys(keys)
+	{
+		for (std::uint32_t seed = 1; ; ++seed) {
+			std::array<std::size_t, table_size> table{};
+			for (auto & e : table) e = npos;
+			bool collision = false;
+			for (std::size_t i = 0; i < N && !collision; ++i) {
+				std::size_t slot = hash(seed, keys[i]) & (table_size - 1);
+				if (table[slot] != npos) {
+					collision = true;
+				}
+				else {
+					table[slot] = i;
+				}
+			}
+			if (!collision) {
+				m_seed = seed;
+				m_table = table;
+				break;
+			}
+		}
+	}
+
+	/*
+	Find index of key.
+	Return:
+		index of key in keys
+		npos if not found
+	*/
+	constexpr std::size_t find(std::string_view key) const
+	{
+		std::size_t i = m_table[hash(m_seed, key) & (table_size - 1)];
+		if (i != npos && equal(m_keys[i], key)) {
+			return i;
+		}
+		return npos;
+	}
+
+private:
+	static constexpr std::size_t tableSize()
+	{
+		std::size_t size = 1;
+		while (size < N * 2) size <<= 1;
+		return size;
+	}
+
+	static constexpr std::size_t table_size = tableSize();
+
+	static constexpr char toLower(char c)
+	{
+		return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+	}
+
+	/*
+	Seeded caseless FNV-1a.
+	*/
+	static constexpr std::uint32_t hash(std::uint32_t seed, std::string_view key)
+	{
+		std::uint32_t h = 2166136261u ^ (seed * 0x9E3779B9u);
+		for (char c : key) {
+			h ^= static_cast<unsigned char>(toLower(c));
+			h *= 16777619u;
+		}
+		h ^= h >> 15;
+		return h;
+	}
+
+	static constexpr bool equal(std::string_view a, std::string_view b)
+	{
+		if (a.size() != b.size()) return false;
+		for (std::size_t i = 0; i < a.size(); ++i) {
+			if (toLower(a[i]) != toLower(b[i])) return false;
+		}
+		return true;
+	}
+
+	std::array<std::string_view, N> m_keys;
+	std::array<std::size_t, table_size> m_table{};
+	std::uint32_t m_seed = 0;
+};
+
+#endif // !CaselessPerfectHash_HEADER
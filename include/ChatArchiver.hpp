@@ -0,0 +1,148 @@
+//ChatArchiver.hpp
+#pragma once
+#ifndef ChatArchiver_HEADER
+#define ChatArchiver_HEADER
+
+//C++
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <filesystem>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdio>
+
+//Date
+#include <date/date.h>
+
+//local
+#include "TimeDetail.hpp"
+
+/*
+Archive of live chat in append-only segment files, one per channel and day
+(UTC), at directory/<channel>/<YYYY-MM-DD>.log.
+Lines are written in the format of gempir channel logs so gempirLogParser
+reads them:
+	[YYYY-MM-DD HH:MM:SS] #channel user: message
+Callers format lines into Lines without any lock and hand them over with
+append, which only moves them into the pending batch. A background thread
+writes the batch every commit_interval (or once commit_bytes are pending) and
+syncs every segment it wrote to once per batch. Segments of days older than
+retention are deleted by the writer thread.
+*/
+class ChatArchiver
+{
+public:
+	using Duration = std::chrono::system_clock::duration;
+
+	/*
+	Directory is created if missing.
+	*/
+	ChatArchiver(
+		const std::filesystem::path & directory,
+		Duration retention,
+		Duration commit_interval = std::chrono::seconds(1),
+		std::size_t commit_bytes = 1024 * 1024
+	);
+
+	/*
+	Write pending lines, then join writer.
+	*/
+	~ChatArchiver();
+
+	ChatArchiver(const ChatArchiver &) = delete;
+	ChatArchiver & operator=(const ChatArchiver &) = delete;
+
+	/*
+	Formatted lines, by segment, not yet handed to the archiver.
+	*/
+	class Lines
+	{
+	public:
+		void add(std::string_view channel, TimeDetail::TimePoint time, std::string_view user, std::string_view message);
+
+		bool empty() const;
+
+	private:
+		friend class ChatArchiver;
+
+		//segment name -> lines
+		std::unordered_map<std::string, std::string> m_segments;
+		std::size_t m_bytes = 0;
+	};
+
+	/*
+	Queue lines, never waits for disk.
+	*/
+	void append(Lines && lines);
+
+	/*
+	Read written lines of segment, lines still pending are not included.
+	Return:
+		content of segment, empty if missing
+	*/
+	std::string read(std::string_view segment);
+
+	/*
+	Segment of channel at date, channel is lowercased, a leading '#' and any
+	character not allowed in a twitch channel name are dropped.
+	*/
+	static std::string createSegmentName(std::string_view channel, const date::year_month_day & date);
+
+private:
+	struct OpenFile
+	{
+		std::FILE * file;
+		TimeDetail::TimePoint last_write;
+	};
+
+	using Batch = Lines;
+
+	void writerFunc();
+
+	/*
+	Append every segment of batch, then sync them.
+	Only called by writer thread.
+	*/
+	void writeBatch(Batch & batch);
+
+	/*
+	Only called by writer thread.
+	*/
+	std::FILE * openSegment(const std::string & segment);
+
+	/*
+	Close segments not written for a while, only called by writer thread.
+	*/
+	void closeIdle(TimeDetail::TimePoint now);
+
+	/*
+	Delete segments of days older than retention, only called by writer thread.
+	*/
+	void removeExpired(TimeDetail::TimePoint now);
+
+	std::filesystem::path m_directory;
+	const Duration m_retention;
+	const Duration m_commit_interval;
+	const std::size_t m_commit_bytes;
+
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	Batch m_pending;
+	bool m_stop = false;
+
+	//writer thread only
+	std::unordered_map<std::string, OpenFile> m_files;
+	const Duration m_idle_close = std::chrono::minutes(1);
+	const Duration m_cleanup_interval = std::chrono::hours(1);
+	TimeDetail::TimePoint m_next_cleanup;
+
+	std::thread m_thread;
+};
+
+#endif // !ChatArchiver_HEADER
@@ -0,0 +1,74 @@
+//ComputePool.hpp
+#pragma once
+#ifndef ComputePool_HEADER
+#define ComputePool_HEADER
+
+//C++
+#include <iostream>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+#include <cassert>
+
+/*
+Work stealing thread pool for CPU bound work (log parsing and scanning), so
+io_context threads only move bytes.
+Every worker has its own deque, tasks posted from a worker go to the back of
+its own deque and are taken from the back (most recent first), idle workers
+steal from the front of the other deques.
+*/
+class ComputePool
+{
+public:
+	using TaskType = std::function<void()>;
+
+	/*
+	threads: number of workers, 0 means one per hardware thread
+	*/
+	ComputePool(std::size_t threads = 0);
+
+	/*
+	Run every posted task, then join workers.
+	Must not run on a worker, so tasks must not own the pool.
+	*/
+	~ComputePool();
+
+	ComputePool(const ComputePool &) = delete;
+	ComputePool & operator=(const ComputePool &) = delete;
+
+	void post(TaskType task);
+
+	std::size_t getNumberOfThreads() const;
+
+private:
+	struct Worker
+	{
+		std::mutex mutex;
+		std::deque<TaskType> tasks;
+	};
+
+	void workerFunc(std::size_t index);
+
+	/*
+	Take task from own deque, else steal from others.
+	*/
+	bool popTask(std::size_t index, TaskType & task);
+
+	std::vector<std::unique_ptr<Worker>> m_workers;
+	std::vector<std::thread> m_threads;
+
+	std::mutex m_sleep_mutex;
+	std::condition_variable m_sleep_cv;
+	//posted tasks not yet taken
+	std::atomic<std::size_t> m_pending = 0;
+	std::atomic<std::size_t> m_next_worker = 0;
+	bool m_stop = false;
+};
+
+#endif // !ComputePool_HEADER
@@ -0,0 +1,147 @@
+//ConnectionPool.hpp
+#pragma once
+#ifndef ConnectionPool_HEADER
+#define ConnectionPool_HEADER
+
+//C++
+#include <iostream>
+#include <string>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+
+//boost
+#include <boost/asio/connect.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/ssl/error.hpp>
+#include <boost/asio/ssl/stream.hpp>
+
+//TLS
+#include "root_certificates.hpp"
+
+/*
+Pool of keep-alive TLS connections shared by all outbound HTTPS clients.
+One ssl context is used for every connection, resolved endpoints and TLS
+sessions are kept per (host, port) so new connections skip DNS and resume
+the previous session. Idle connections are closed after idle_timeout.
+*/
+class ConnectionPool : public std::enable_shared_from_this<ConnectionPool>
+{
+public:
+	using Stream = boost::asio::ssl::stream<boost::asio::ip::tcp::socket>;
+	using StreamPtr = std::unique_ptr<Stream>;
+	using Clock = std::chrono::steady_clock;
+	/*
+	Handler(ec, stream, reused)
+		reused is true if stream was idle in pool, it may have been closed by
+		the server in the meantime and should be retried on a new connection
+		if the first request fails
+	*/
+	using HandlerType = std::function<void(boost::system::error_code, StreamPtr, bool)>;
+
+	/*
+	Max idle connections kept per (host, port).
+	*/
+	static constexpr std::size_t max_idle_per_host = 8;
+
+	/*
+	How long resolved endpoints are reused.
+	*/
+	static constexpr std::chrono::minutes resolve_ttl{ 5 };
+
+	ConnectionPool(boost::asio::io_context & ioc, Clock::duration idle_timeout = std::chrono::seconds(30));
+
+	~ConnectionPool();
+
+	boost::asio::io_context & getIoContext();
+
+	/*
+	Get connected and handshaked stream to host.
+	Handler is called from the io_context, never from inside acquire.
+	*/
+	void acquire(const std::string & host, const std::string & port, HandlerType handler);
+
+	/*
+	Give stream back after a complete response with keep-alive.
+	Streams that should not be reused are simply destroyed by the caller.
+	*/
+	void release(const std::string & host, const std::string & port, StreamPtr stream);
+
+private:
+	class Connector;
+
+	struct Idle
+	{
+		StreamPtr stream;
+		Clock::time_point since;
+	};
+
+	struct HostEntry
+	{
+		std::vector<Idle> idle;
+		boost::asio::ip::tcp::resolver::results_type results;
+		Clock::time_point resolved;
+		SSL_SESSION * session = nullptr;
+	};
+
+	static std::string createKey(const std::string & host, const std::string & port);
+
+	/*
+	Remember session of stream for resumption.
+	Must hold m_mutex.
+	*/
+	void saveSession(HostEntry & entry, Stream & stream);
+
+	/*
+	Must hold m_mutex.
+	*/
+	void startReapTimer();
+
+	void reapHandler(boost::system::error_code ec);
+
+	boost::asio::io_context & m_ioc;
+	boost::asio::ssl::context m_ctx;
+	Clock::duration m_idle_timeout;
+	boost::asio::steady_timer m_reap_timer;
+	bool m_reap_timer_running = false;
+
+	std::mutex m_mutex;
+	std::unordered_map<std::string, HostEntry> m_hosts;
+};
+
+/*
+Resolve (if not cached), connect and handshake one new stream.
+*/
+class ConnectionPool::Connector : public std::enable_shared_from_this<ConnectionPool::Connector>
+{
+public:
+	Connector(std::shared_ptr<ConnectionPool> pool, const std::string & host, const std::string & port, HandlerType handler);
+
+	void run();
+
+private:
+	void resolveHandler(boost::system::error_code ec, boost::asio::ip::tcp::resolver::results_type results);
+
+	void connect(const boost::asio::ip::tcp::resolver::results_type & results);
+
+	void connectHandler(boost::system::error_code ec);
+
+	void handshakeHandler(boost::system::error_code ec);
+
+	void fail(boost::system::error_code ec);
+
+	std::shared_ptr<ConnectionPool> m_pool;
+	std::string m_host;
+	std::string m_port;
+	HandlerType m_handler;
+	boost::asio::ip::tcp::resolver m_resolver;
+	StreamPtr m_stream;
+};
+
+#endif // !ConnectionPool_HEADER
@@ -13,8 +13,9 @@
 #include <boost/asio/ssl.hpp>
 #include <boost/beast.hpp>
 
-//TLS
-#include "root_certificates.hpp"
+//local
+#include "ConnectionPool.hpp"
+#include "GeneratorBody.hpp"
 
 namespace DankHttp
 {
@@ -25,16 +26,16 @@ namespace DankHttp
 	{
 	public:
 		using CallbackType = std::function<void(std::string&&)>;
-		using RequestType = boost::beast::http::request<boost::beast::http::string_body>;
+		//append next piece of data to buffer and return true, return false when there is no more
+		using GeneratorType = GeneratorBody::value_type::GeneratorType;
+		//create generator starting at beginning of data, called again if upload is retried
+		using GeneratorFactoryType = std::function<GeneratorType()>;
+		using RequestType = boost::beast::http::request<GeneratorBody>;
 		using ResponseType = boost::beast::http::response<boost::beast::http::string_body>;
 
 		/*
 		*/
-		NuulsUploader(boost::asio::io_context & ioc);
-
-		/*
-		*/
-		static std::string packBody(const std::string & data);
+		NuulsUploader(std::shared_ptr<ConnectionPool> pool);
 
 		/*
 		*/
@@ -48,36 +49,56 @@ namespace DankHttp
 		);
 
 		/*
+		Upload data pulled from generator, the request is sent chunked and the
+		multipart framing is added on the fly so data is never held as a whole.
 		*/
-		void resolveHandler(boost::system::error_code ec, boost::asio::ip::tcp::resolver::results_type results);
+		void run(
+			CallbackType callback,
+			GeneratorFactoryType generator_factory,
+			const std::string & host,
+			const std::string & port,
+			const std::string & target,
+			int version = 11
+		);
 
 		/*
 		*/
-		void connectHandler(boost::system::error_code ec);
+		void acquireHandler(boost::system::error_code ec, ConnectionPool::StreamPtr stream, bool reused);
 
 		/*
 		*/
-		void handshakeHandler(boost::system::error_code ec);
+		void writeHandler(boost::system::error_code ec, std::size_t bytes_transferred);
 
 		/*
 		*/
-		void writeHandler(boost::system::error_code ec, std::size_t bytes_transferred);
+		void readHandler(boost::system::error_code ec, std::size_t bytes_transferred);
+
+	private:
+		enum class BodyStage
+		{
+			preamble,
+			data,
+			epilogue,
+			done
+		};
+
+		void acquire();
 
 		/*
+		Multipart body around data from m_generator.
 		*/
-		void readHandler(boost::system::error_code ec, std::size_t bytes_transferred);
+		bool generateBody(std::string & buffer);
 
 		/*
+		Retry on new connection if pooled stream was closed by server, else throw.
 		*/
-		void shutdownHandler(boost::system::error_code ec);
+		void failureHandler(boost::system::error_code ec);
 
-	private:
-		boost::asio::io_context & m_ioc;
-		boost::asio::ssl::context m_ctx;
-		boost::asio::ip::tcp::resolver m_resolver;
+		std::shared_ptr<ConnectionPool> m_pool;
 		boost::beast::flat_buffer m_buffer;
 
-		std::unique_ptr<boost::asio::ssl::stream<boost::asio::ip::tcp::socket>> m_stream_ptr;
+		ConnectionPool::StreamPtr m_stream_ptr;
+		bool m_reused = false;
 		
 		std::string m_host;
 		std::string m_port;
@@ -87,7 +108,10 @@ namespace DankHttp
 		RequestType m_request;
 		ResponseType m_response;
 
-		//std::string m_upload_data;
+		GeneratorFactoryType m_generator_factory;
+		GeneratorType m_generator;
+		BodyStage m_body_stage = BodyStage::preamble;
+
 		CallbackType m_callback;
 	};
 
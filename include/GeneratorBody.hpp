@@ -0,0 +1,73 @@
+//GeneratorBody.hpp
+#pragma once
+#ifndef GeneratorBody_HEADER
+#define GeneratorBody_HEADER
+
+//C++
+#include <string>
+#include <functional>
+#include <utility>
+
+//boost
+#include <boost/optional.hpp>
+#include <boost/core/ignore_unused.hpp>
+#include <boost/asio/buffer.hpp>
+#include <boost/beast/http/message.hpp>
+#include <boost/beast/http/error.hpp>
+
+/*
+Beast body for writing only, the body is never stored as a whole.
+Data is pulled from generator while the message is serialized, generator
+appends the next piece to buffer and returns false once it has nothing more.
+Pieces are gathered until chunk_size bytes are pending, so the message must
+be sent chunked.
+*/
+struct GeneratorBody
+{
+	struct value_type
+	{
+		using GeneratorType = std::function<bool(std::string&)>;
+		GeneratorType generator;
+		std::size_t chunk_size = 64 * 1024;
+	};
+
+	class writer
+	{
+	public:
+		using const_buffers_type = boost::asio::const_buffer;
+
+		template <bool isRequest, class Fields>
+		writer(const boost::beast::http::header<isRequest, Fields> & header, const value_type & body) :
+			m_body(body)
+		{
+			boost::ignore_unused(header);
+		}
+
+		void init(boost::system::error_code & ec)
+		{
+			m_done = !m_body.generator;
+			ec = {};
+		}
+
+		boost::optional<std::pair<const_buffers_type, bool>> get(boost::system::error_code & ec)
+		{
+			ec = {};
+			//previous buffer has been written when get is called again
+			m_buffer.clear();
+			while (!m_done && m_buffer.size() < m_body.chunk_size) {
+				m_done = !m_body.generator(m_buffer);
+			}
+			if (m_buffer.empty()) {
+				return boost::none;
+			}
+			return std::make_pair(const_buffers_type(m_buffer.data(), m_buffer.size()), !m_done);
+		}
+
+	private:
+		const value_type & m_body;
+		std::string m_buffer;
+		bool m_done = false;
+	};
+};
+
+#endif // !GeneratorBody_HEADER
@@ -0,0 +1,61 @@
+//IRCLineFramer.hpp
+#pragma once
+#ifndef IRCLineFramer_HEADER
+#define IRCLineFramer_HEADER
+
+//C++
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <cstring>
+#include <cassert>
+
+//boost
+#include <boost/asio/buffer.hpp>
+
+/*
+Splits a byte stream into "\r\n" terminated lines.
+Reads go straight into the tail of the buffer (prepare/commit), lines are
+handed out as views into the buffer and consumed by advancing an offset.
+The unconsumed tail is moved to the front once per read by compact().
+*/
+class IRCLineFramer
+{
+public:
+	/*
+	*/
+	IRCLineFramer(std::size_t capacity);
+
+	/*
+	Get writable tail of buffer.
+	Grows buffer if there is no room left.
+	*/
+	boost::asio::mutable_buffer prepare();
+
+	/*
+	Mark n bytes of the buffer returned by prepare() as received.
+	*/
+	void commit(std::size_t n);
+
+	/*
+	Get next complete line without "\r\n".
+	View is valid until next call to compact() or prepare().
+	Return:
+		line if there is a complete line in buffer
+		std::nullopt if not
+	*/
+	std::optional<std::string_view> nextLine();
+
+	/*
+	Move unconsumed bytes to front of buffer.
+	*/
+	void compact();
+
+private:
+	std::vector<char> m_buffer;
+	std::size_t m_begin = 0;	//first unconsumed byte
+	std::size_t m_scan = 0;		//first byte not yet searched for "\r\n"
+	std::size_t m_end = 0;		//end of received bytes
+};
+
+#endif // !IRCLineFramer_HEADER
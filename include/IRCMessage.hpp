@@ -10,6 +10,11 @@
 #include <string>
 #include <string_view>
 #include <vector>
+#include <array>
+#include <memory>
+#include <iterator>
+#include <optional>
+#include <cstdint>
 #include <cassert>
 #include <algorithm>
 
@@ -19,22 +24,130 @@ public:
 	using TimePoint = std::chrono::system_clock::time_point;
 
 	/*
+	Storage block holding the raw line.
+	Lines from the same read share one block (see parseBatch).
 	*/
-	IRCMessage()
+	using Storage = std::shared_ptr<const std::string>;
+
+	/*
+	IRC allows at most 15 params.
+	*/
+	static constexpr std::size_t max_params = 15;
+
+	/*
+	Lines are indexed with 16 bit offsets, longer lines are truncated.
+	*/
+	static constexpr std::size_t max_line_size = 0xFFFF;
+
+	/*
+	Part of line as offset from start of line.
+	*/
+	struct Span
 	{
-	}
-	IRCMessage(const TimePoint time, std::string && buf) :
-		m_time(time),
-		m_data(std::move(buf))
+		std::uint16_t offset = 0;
+		std::uint16_t size = 0;
+	};
+
+	/*
+	View of params.
+	*/
+	class Params
+	{
+	public:
+		class Iterator
+		{
+		public:
+			using iterator_category = std::forward_iterator_tag;
+			using value_type = std::string_view;
+			using difference_type = std::ptrdiff_t;
+			using pointer = const std::string_view*;
+			using reference = std::string_view;
+
+			Iterator(const char * data, const Span * span) :
+				m_data(data),
+				m_span(span)
+			{
+			}
+			std::string_view operator*() const
+			{
+				return std::string_view(m_data + m_span->offset, m_span->size);
+			}
+			Iterator & operator++()
+			{
+				++m_span;
+				return *this;
+			}
+			Iterator operator++(int)
+			{
+				Iterator temp = *this;
+				++m_span;
+				return temp;
+			}
+			bool operator==(const Iterator & other) const
+			{
+				return m_span == other.m_span;
+			}
+			bool operator!=(const Iterator & other) const
+			{
+				return m_span != other.m_span;
+			}
+		private:
+			const char * m_data;
+			const Span * m_span;
+		};
+
+		Params(const char * data, const Span * spans, std::size_t size) :
+			m_data(data),
+			m_spans(spans),
+			m_size(size)
+		{
+		}
+		std::string_view operator[](std::size_t i) const
+		{
+			assert(i < m_size);
+			return std::string_view(m_data + m_spans[i].offset, m_spans[i].size);
+		}
+		std::size_t size() const
+		{
+			return m_size;
+		}
+		bool empty() const
+		{
+			return m_size == 0;
+		}
+		Iterator begin() const
+		{
+			return Iterator(m_data, m_spans);
+		}
+		Iterator end() const
+		{
+			return Iterator(m_data, m_spans + m_size);
+		}
+	private:
+		const char * m_data;
+		const Span * m_spans;
+		std::size_t m_size;
+	};
+
+	/*
+	*/
+	IRCMessage()
 	{
-		parseImplementation();
 	}
+	IRCMessage(const TimePoint time, std::string && buf);
+	IRCMessage(const TimePoint time, std::string_view line);
+
+	/*
+	Construct from line inside storage block.
+	*/
+	IRCMessage(const TimePoint time, Storage storage, std::string_view line);
 
 	/*
 	Copy.
+	Copies only offsets and the storage reference.
 	*/
-	IRCMessage(const IRCMessage & source);
-	IRCMessage & operator=(const IRCMessage & source);
+	IRCMessage(const IRCMessage & source) = default;
+	IRCMessage & operator=(const IRCMessage & source) = default;
 
 	/*
 	Move
@@ -42,17 +155,65 @@ public:
 	IRCMessage(IRCMessage && source) = default;
 	IRCMessage & operator=(IRCMessage && source) = default;
 
+	/*
+	Parse lines into messages sharing a single storage block.
+	Template:
+		Container		container with emplace_back(IRCMessage&&)
+	*/
+	template <typename Container>
+	static void parseBatch(const TimePoint time, const std::vector<std::string_view> & lines, Container & out)
+	{
+		std::size_t total = 0;
+		for (auto & line : lines) {
+			total += std::min(line.size(), max_line_size);
+		}
+		auto block = std::make_shared<std::string>();
+		block->reserve(total);
+		for (auto & line : lines) {
+			block->append(line.substr(0, max_line_size));
+		}
+		Storage storage = std::move(block);
+		std::size_t offset = 0;
+		for (auto & line : lines) {
+			std::size_t size = std::min(line.size(), max_line_size);
+			out.emplace_back(IRCMessage(time, storage, std::string_view(storage->data() + offset, size)));
+			offset += size;
+		}
+	}
+
 	/*
 	Getters.
 	*/
 	const TimePoint & getTime() const;
-	const std::string & getData() const;
-	const std::string_view & getNick() const;
-	const std::string_view & getUser() const;
-	const std::string_view & getHost() const;
-	const std::string_view & getCommand() const;
-	const std::vector<std::string_view> & getParams() const;
-	const std::string_view & getBody() const;
+	std::string_view getData() const;
+	std::string_view getNick() const;
+	std::string_view getUser() const;
+	std::string_view getHost() const;
+	std::string_view getCommand() const;
+	Params getParams() const;
+	std::string_view getBody() const;
+
+	/*
+	Get raw IRCv3 tag section without leading '@'.
+	*/
+	std::string_view getTags() const;
+
+	/*
+	Find tag value without unescaping.
+	Tags are only scanned when asked for.
+	Return:
+		escaped value if key is present (empty if tag has no value)
+		std::nullopt if not
+	*/
+	std::optional<std::string_view> getTagView(std::string_view key) const;
+
+	/*
+	Find tag value and unescape it.
+	Return:
+		value if key is present (empty if tag has no value)
+		std::nullopt if not
+	*/
+	std::optional<std::string> getTag(std::string_view key) const;
 
 	/*
 	*/
@@ -63,18 +224,20 @@ private:
 	*/
 	void parseImplementation();
 
-	/*
-	*/
-	void copyImplementation(const IRCMessage & source);
+	std::string_view view(const Span & span) const;
 
 	TimePoint m_time;
-	std::string m_data;
-	std::string_view m_nick_view;
-	std::string_view m_user_view;
-	std::string_view m_host_view;
-	std::string_view m_command_view;
-	std::vector<std::string_view> m_params_vec;
-	std::string_view m_body_view;
+	Storage m_storage;
+	const char * m_data = nullptr;
+	std::uint16_t m_size = 0;
+	std::uint8_t m_params_count = 0;
+	Span m_tags;
+	Span m_nick;
+	Span m_user;
+	Span m_host;
+	Span m_command;
+	Span m_body;
+	std::array<Span, max_params> m_params;
 };
 
 #endif
@@ -5,37 +5,90 @@
 
 //C++
 #include <iostream>
-#include <mutex>
-#include <deque>
-#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
 #include <cassert>
 
 //local
 #include "IRCMessage.hpp"
 
+/*
+Fixed capacity ring of the latest messages of a channel, one producer and any
+number of readers.
+Every slot is preallocated and guarded by a sequence lock: the producer makes
+the sequence odd, writes time, nick and body in place and makes it even
+again, so push never allocates or waits. Readers copy a slot and keep the copy
+only if the sequence was even and unchanged, a slot overwritten while being
+copied is dropped instead of waited for.
+Slot contents are stored as relaxed atomic words so concurrent copies are not
+data races.
+*/
 class IRCMessageBuffer
 {
 public:
-	using Container = std::deque<IRCMessage>;
+	using TimePoint = IRCMessage::TimePoint;
 
-	IRCMessageBuffer(std::size_t capacity);
+	/*
+	Bytes of nick and body kept per message, longer bodies are truncated.
+	Twitch nicks are at most 25 characters and messages at most 500, rounded up
+	to whole words since every slot is preallocated.
+	*/
+	static constexpr std::size_t max_text_size = (25 + 500 + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t) * sizeof(std::uint64_t);
 
-	void push(IRCMessage && msg);
+	/*
+	Copy of a buffered message.
+	*/
+	struct Line
+	{
+		TimePoint time;
+		std::string nick;
+		std::string body;
+	};
+
+	IRCMessageBuffer(std::size_t capacity);
 
 	/*
+	Only one thread may push at a time.
 	*/
-	using AccessDataFunc = std::function<void(const Container&)>;
-	void accessData(AccessDataFunc func);
+	void push(const IRCMessage & msg);
 
 	/*
+	Copy the latest line_count messages, oldest first.
+	Never blocks push.
 	*/
-	using LinesFromNowVecType = std::vector<std::reference_wrapper<const IRCMessage>>;
-	using LinesFromNowFuncType = std::function<void(const LinesFromNowVecType&)>;
-	void accessLinesFromNow(std::size_t line_count, LinesFromNowFuncType func);
+	using LinesFromNowVecType = std::vector<Line>;
+	LinesFromNowVecType copyLinesFromNow(std::size_t line_count) const;
+
 private:
-	std::mutex m_mutex;
+	static constexpr std::size_t header_words = 3;
+	static constexpr std::size_t text_words = max_text_size / sizeof(std::uint64_t);
+
+	struct Slot
+	{
+		//odd while written
+		std::atomic<std::uint64_t> sequence{ 0 };
+		//message number, time, nick size | body size << 16, then text
+		std::atomic<std::uint64_t> words[header_words + text_words];
+	};
+
+	/*
+	Copy slot of message number index.
+	Return:
+		true if line holds message index
+	*/
+	bool readSlot(std::uint64_t index, Line & line, std::uint64_t * buffer) const;
+
 	std::size_t m_capacity;
-	Container m_queue;
+	std::unique_ptr<Slot[]> m_slots;
+	//number of messages pushed
+	std::atomic<std::uint64_t> m_head{ 0 };
 };
 
 #endif // !IRCMessageBuffer_HEADER
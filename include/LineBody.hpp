@@ -0,0 +1,89 @@
+//LineBody.hpp
+#pragma once
+#ifndef LineBody_HEADER
+#define LineBody_HEADER
+
+//C++
+#include <string>
+#include <functional>
+#include <optional>
+#include <cstdint>
+#include <algorithm>
+
+//boost
+#include <boost/core/ignore_unused.hpp>
+#include <boost/asio/buffer.hpp>
+#include <boost/beast/http/message.hpp>
+#include <boost/beast/http/error.hpp>
+
+/*
+Beast body for reading only, the body is never stored as a whole.
+Received bytes are handed to sink in chunks of complete lines once at least
+batch_size bytes are pending, the rest is handed over when the body ends.
+*/
+struct LineBody
+{
+	struct value_type
+	{
+		using SinkType = std::function<void(std::string&&)>;
+		SinkType sink;
+		std::size_t batch_size = 256 * 1024;
+		std::string pending;
+	};
+
+	class reader
+	{
+	public:
+		template <bool isRequest, class Fields>
+		reader(boost::beast::http::header<isRequest, Fields> & header, value_type & body) :
+			m_body(body)
+		{
+			boost::ignore_unused(header);
+		}
+
+		void init(const boost::optional<std::uint64_t> & content_length, boost::system::error_code & ec)
+		{
+			m_body.pending.clear();
+			if (content_length) {
+				m_body.pending.reserve(static_cast<std::size_t>(std::min<std::uint64_t>(*content_length, m_body.batch_size * 2)));
+			}
+			ec = {};
+		}
+
+		template <class ConstBufferSequence>
+		std::size_t put(const ConstBufferSequence & buffers, boost::system::error_code & ec)
+		{
+			std::size_t size = 0;
+			for (auto it = boost::asio::buffer_sequence_begin(buffers); it != boost::asio::buffer_sequence_end(buffers); ++it) {
+				boost::asio::const_buffer buffer(*it);
+				m_body.pending.append(static_cast<const char*>(buffer.data()), buffer.size());
+				size += buffer.size();
+			}
+			if (m_body.pending.size() >= m_body.batch_size) {
+				auto pos = m_body.pending.rfind('\n');
+				if (pos != std::string::npos) {
+					std::string rest(m_body.pending, pos + 1);
+					m_body.pending.resize(pos + 1);
+					m_body.sink(std::move(m_body.pending));
+					m_body.pending = std::move(rest);
+				}
+			}
+			ec = {};
+			return size;
+		}
+
+		void finish(boost::system::error_code & ec)
+		{
+			if (!m_body.pending.empty()) {
+				m_body.sink(std::move(m_body.pending));
+				m_body.pending.clear();
+			}
+			ec = {};
+		}
+
+	private:
+		value_type & m_body;
+	};
+};
+
+#endif // !LineBody_HEADER
@@ -8,11 +8,18 @@
 #include <string>
 #include <string_view>
 #include <vector>
+#include <memory>
+#include <functional>
 #include <chrono>
+#include <cassert>
+#include <utility>
 
 //local
 #include "TimeDetail.hpp"
 
+class LogArchive;
+class TokenIndex;
+
 class Log
 {
 public:
@@ -70,6 +77,18 @@ public:
 			copyLineViewImpl(line_view);
 		}
 
+		/*
+		Line without raw text, time view is empty.
+		*/
+		Line(TimeDetail::TimePoint time, std::string_view name_view, std::string_view message_view) :
+			m_time(time)
+		{
+			m_line.reserve(name_view.size() + message_view.size());
+			m_line.append(name_view).append(message_view);
+			m_name_view = std::string_view(m_line.data(), name_view.size());
+			m_message_view = std::string_view(m_line.data() + name_view.size(), message_view.size());
+		}
+
 		Line(const Line & source)
 		{
 			copyLineImpl(source);
@@ -145,24 +164,92 @@ public:
 	//Log() = default;
 	Log(TimeDetail::TimePeriod && period, ChannelName && channel_name, std::string && data, ParserFunc parser);
 
+	/*
+	Log backed by mapped archive, lines are read from archive columns.
+	*/
+	Log(TimeDetail::TimePeriod && period, ChannelName && channel_name, std::shared_ptr<const LogArchive> archive);
+
+	/*
+	Log of lines [first, last) of archive, used to scan one archive in parallel.
+	*/
+	Log(TimeDetail::TimePeriod && period, ChannelName && channel_name, std::shared_ptr<const LogArchive> archive, std::size_t first, std::size_t last);
+
+	/*
+	Line views point into data, they are rebased if data moved
+	(short strings are stored inline).
+	*/
+	Log(Log && source);
+
 	bool isValid() const;
 
 	TimeDetail::TimePeriod getPeriod() const;
 
 	const std::string & getChannelName() const;
 
+	/*
+	Raw data, empty if backed by archive.
+	*/
 	const std::string & getData() const;
 
+	/*
+	Parsed lines, empty if backed by archive.
+	*/
 	const std::vector<LineView> & getLines() const;
 
+	/*
+	Archive, nullptr if backed by raw data.
+	*/
+	const std::shared_ptr<const LogArchive> & getArchive() const;
+
 	std::size_t getNumberOfLines() const;
 
+	/*
+	Line access by index, works for both raw data and archive.
+	*/
+	TimeDetail::TimePoint getTime(std::size_t i) const;
+	std::string_view getName(std::size_t i) const;
+	std::string_view getMessage(std::size_t i) const;
+	Line getLine(std::size_t i) const;
+
+	/*
+	Token index of archive, nullptr if not backed by an archive with one.
+	Line ids in the index are archive line ids, line i of this log is
+	archive line getArchiveFirst() + i.
+	*/
+	const TokenIndex * getTokenIndex() const;
+
+	std::size_t getArchiveFirst() const;
+
+	/*
+	Check if lines are in time order, decided once when log is created.
+	*/
+	bool isSorted() const;
+
+	/*
+	Index range [first, second) of lines that may be inside period.
+	If lines are sorted the range is found by binary search and every line
+	in it is inside period, else the range is all lines.
+	*/
+	std::pair<std::size_t, std::size_t> getLineRange(const TimeDetail::TimePeriod & period) const;
+
 private:
+	void checkSorted();
+
+	/*
+	First line index in [0, size) with time not less than point, lines must be sorted.
+	*/
+	std::size_t lowerBound(TimeDetail::TimePoint point) const;
+
 	bool m_valid = false;
+	bool m_sorted = false;
 	const TimeDetail::TimePeriod m_period;
 	ChannelName m_channel_name;
 	std::string m_data;
 	std::vector<LineView> m_lines;
+	std::shared_ptr<const LogArchive> m_archive;
+	//lines of archive in this log
+	std::size_t m_archive_first = 0;
+	std::size_t m_archive_size = 0;
 };
 
 #endif // !Log_HEADER
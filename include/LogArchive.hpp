@@ -0,0 +1,197 @@
+//LogArchive.hpp
+#pragma once
+#ifndef LogArchive_HEADER
+#define LogArchive_HEADER
+
+//C++
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <filesystem>
+#include <unordered_map>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+
+//boost
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+//local
+#include "TimeDetail.hpp"
+#include "Log.hpp"
+#include "TokenIndex.hpp"
+
+/*
+Read-only columnar log archive.
+Written once from a parsed Log, then memory mapped.
+
+Layout (native byte order, every section 8 byte aligned):
+	Header
+	std::int64_t	times[line_count]				seconds since epoch
+	std::uint32_t	user_ids[line_count]
+	std::uint64_t	user_offsets[user_count + 1]
+	char			user_blob[user_blob_size]
+	std::uint64_t	message_offsets[line_count + 1]
+	char			message_blob[message_blob_size]
+	TokenIndex										if has_token_index
+*/
+class LogArchive
+{
+public:
+	static constexpr std::uint32_t version = 1;
+
+	enum Flags : std::uint32_t
+	{
+		sorted_by_time = 1,
+		has_token_index = 2
+	};
+
+	struct Header
+	{
+		char magic[8];
+		std::uint32_t version;
+		std::uint32_t flags;
+		std::uint64_t line_count;
+		std::uint64_t user_count;
+		std::uint64_t user_blob_size;
+		std::uint64_t message_blob_size;
+	};
+
+	class Builder;
+
+	/*
+	Map archive starting at offset in file.
+	Return:
+		archive if file holds a valid archive at offset
+		nullptr if not
+	*/
+	static std::shared_ptr<const LogArchive> open(const std::filesystem::path & path, std::uint64_t offset = 0);
+
+	std::size_t size() const
+	{
+		return static_cast<std::size_t>(m_header->line_count);
+	}
+
+	bool isSortedByTime() const
+	{
+		return (m_header->flags & Flags::sorted_by_time) != 0;
+	}
+
+	TimeDetail::TimePoint getTime(std::size_t i) const
+	{
+		return TimeDetail::TimePoint(std::chrono::seconds(m_times[i]));
+	}
+
+	std::uint32_t getUserId(std::size_t i) const
+	{
+		return m_user_ids[i];
+	}
+
+	std::size_t getNumberOfUsers() const
+	{
+		return static_cast<std::size_t>(m_header->user_count);
+	}
+
+	std::string_view getUserName(std::uint32_t user_id) const
+	{
+		return std::string_view(m_user_blob + m_user_offsets[user_id], m_user_offsets[user_id + 1] - m_user_offsets[user_id]);
+	}
+
+	std::string_view getName(std::size_t i) const
+	{
+		return getUserName(m_user_ids[i]);
+	}
+
+	std::string_view getMessage(std::size_t i) const
+	{
+		return std::string_view(m_message_blob + m_message_offsets[i], m_message_offsets[i + 1] - m_message_offsets[i]);
+	}
+
+	/*
+	Token index of messages, nullptr if archive was written without one.
+	*/
+	const TokenIndex * getTokenIndex() const
+	{
+		return m_token_index ? &*m_token_index : nullptr;
+	}
+
+private:
+	struct Layout
+	{
+		std::uint64_t times;
+		std::uint64_t user_ids;
+		std::uint64_t user_offsets;
+		std::uint64_t user_blob;
+		std::uint64_t message_offsets;
+		std::uint64_t message_blob;
+		std::uint64_t end;
+	};
+
+	static Layout computeLayout(const Header & header);
+
+	LogArchive() = default;
+
+	boost::interprocess::file_mapping m_file;
+	boost::interprocess::mapped_region m_region;
+	const Header * m_header = nullptr;
+	const std::int64_t * m_times = nullptr;
+	const std::uint32_t * m_user_ids = nullptr;
+	const std::uint64_t * m_user_offsets = nullptr;
+	const char * m_user_blob = nullptr;
+	const std::uint64_t * m_message_offsets = nullptr;
+	const char * m_message_blob = nullptr;
+	std::optional<TokenIndex> m_token_index;
+};
+
+/*
+Build archive from logs appended one after another, e.g. batches of a log
+that is still downloading. Columns are kept in memory, messages are spilled
+to a file so the raw text does not have to stay resident.
+*/
+class LogArchive::Builder
+{
+public:
+	/*
+	Spill file is created at spill_path and removed on destruction.
+	token_index: also build a TokenIndex of the messages
+	*/
+	Builder(const std::filesystem::path & spill_path, bool token_index = false);
+
+	~Builder();
+
+	Builder(const Builder &) = delete;
+	Builder & operator=(const Builder &) = delete;
+
+	/*
+	Append all lines of log.
+	*/
+	void append(const Log & log);
+
+	/*
+	Write archive at current position of stream.
+	Position must be 8 byte aligned relative to the start of the file.
+	Return:
+		true if written
+		false if stream or spill file failed
+	*/
+	bool write(std::ostream & stream);
+
+private:
+	std::filesystem::path m_spill_path;
+	std::ofstream m_spill;
+	bool m_sorted = true;
+	std::vector<std::int64_t> m_times;
+	std::vector<std::uint32_t> m_user_ids;
+	std::vector<std::uint64_t> m_user_offsets{ 0 };
+	std::string m_user_blob;
+	std::vector<std::uint64_t> m_message_offsets{ 0 };
+	std::unordered_map<std::string, std::uint32_t> m_user_map;
+	std::string m_name_key; //reused for lookups
+	std::optional<TokenIndex::Builder> m_token_index;
+};
+
+#endif // !LogArchive_HEADER
@@ -0,0 +1,150 @@
+//LogCache.hpp
+#pragma once
+#ifndef LogCache_HEADER
+#define LogCache_HEADER
+
+//C++
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <optional>
+#include <filesystem>
+#include <unordered_map>
+#include <list>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <iomanip>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+
+//local
+#include "TimeDetail.hpp"
+#include "Log.hpp"
+#include "LogArchive.hpp"
+
+/*
+On-disk cache of downloaded logs keyed by host and target.
+Logs are stored as LogArchive and memory mapped on load.
+Targets whose period has ended are kept until evicted, targets whose period
+is still open expire after a ttl. Total size is kept below a cap by evicting
+least recently used entries.
+*/
+class LogCache
+{
+public:
+	using Duration = std::chrono::system_clock::duration;
+
+	/*
+	Index existing cache files in directory, directory is created if missing.
+	Temp files left by a run that stopped mid write are removed.
+	token_index: store a TokenIndex with every archive
+	*/
+	LogCache(const std::filesystem::path & directory, std::uintmax_t max_size, Duration open_period_ttl, bool token_index = false);
+
+	/*
+	Load cached log.
+	Return:
+		mapped archive if cached and not expired
+		nullptr if not
+	*/
+	std::shared_ptr<const LogArchive> load(std::string_view host, std::string_view target);
+
+	class Writer;
+
+	/*
+	Start storing a log that arrives in batches.
+	*/
+	std::unique_ptr<Writer> createWriter(std::string_view host, std::string_view target, const TimeDetail::TimePeriod & period);
+
+	/*
+	Store log as archive.
+	*/
+	void store(std::string_view host, std::string_view target, const TimeDetail::TimePeriod & period, const Log & log);
+
+private:
+	struct Entry
+	{
+		std::uintmax_t size;
+		std::list<std::string>::iterator lru_it;
+	};
+
+	/*
+	Archive starts at first 8 byte boundary after the text header.
+	*/
+	static std::uint64_t alignHeader(std::uint64_t header_size);
+
+	static std::string createKey(std::string_view host, std::string_view target);
+
+	static std::string createFileName(const std::string & key);
+
+	/*
+	Unique path in cache directory for file being written.
+	*/
+	std::filesystem::path createTempPath(const std::string & file_name, std::string_view suffix);
+
+	/*
+	Move finished temporary file into cache.
+	*/
+	void insert(const std::string & file_name, const std::filesystem::path & temp_path);
+
+	/*
+	Must hold m_mutex.
+	*/
+	void touch(const std::string & file_name);
+
+	/*
+	Must hold m_mutex.
+	*/
+	void erase(const std::string & file_name);
+
+	/*
+	Must hold m_mutex.
+	*/
+	void evict();
+
+	std::mutex m_mutex;
+	std::filesystem::path m_directory;
+	std::uintmax_t m_max_size;
+	Duration m_open_period_ttl;
+	bool m_token_index;
+	std::uintmax_t m_size = 0;
+	std::list<std::string> m_lru; //front is most recently used
+	std::unordered_map<std::string, Entry> m_entries;
+	std::atomic<std::uint64_t> m_temp_counter{ 0 };
+};
+
+/*
+Incremental store of one log, nothing is visible in the cache until commit.
+Must not outlive the LogCache.
+*/
+class LogCache::Writer
+{
+public:
+	/*
+	Append batch of lines.
+	*/
+	void append(const Log & log);
+
+	/*
+	Write archive and add it to cache.
+	*/
+	void commit();
+
+private:
+	friend class LogCache;
+
+	Writer(LogCache & cache, std::string && key, std::string && file_name, std::int64_t expires);
+
+	LogCache & m_cache;
+	std::string m_key;
+	std::string m_file_name;
+	std::int64_t m_expires;
+	LogArchive::Builder m_builder;
+};
+
+#endif // !LogCache_HEADER
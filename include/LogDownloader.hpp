@@ -15,6 +15,8 @@
 #include <mutex>
 #include <chrono>
 #include <limits>
+#include <deque>
+#include <map>
 
 //Date
 #include <date/date.h>
@@ -24,6 +26,8 @@
 #include <boost/beast/http.hpp>
 #include <boost/beast/version.hpp>
 #include <boost/asio/connect.hpp>
+#include <boost/asio/io_context_strand.hpp>
+#include <boost/asio/bind_executor.hpp>
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/asio/ssl/error.hpp>
 #include <boost/asio/ssl/stream.hpp>
@@ -34,26 +38,54 @@
 //local
 #include "TimeDetail.hpp"
 #include "Log.hpp"
+#include "LogCache.hpp"
+#include "RollupStore.hpp"
+#include "ChatArchiver.hpp"
+#include "ComputePool.hpp"
+#include "ConnectionPool.hpp"
+#include "LineBody.hpp"
 
 enum class LogService
 {
 	gempir_log,
-	overrustle_log
+	overrustle_log,
+	//ChatArchiver of this bot
+	local_log
 };
 
 struct LogRequest
 {
 	using CallbackType = std::function<void(Log&&)>;
+	using TargetDoneHandlerType = std::function<void()>;
 	using ErrorHandlerType = std::function<void()>;
-	//tuple<period, channel_name, log_target>
-	using Target = std::tuple<TimeDetail::TimePeriod, std::string, std::string>;
+	//tuple<period, channel_name, log_target, user>, user is empty for channel logs
+	using Target = std::tuple<TimeDetail::TimePeriod, std::string, std::string, std::string>;
 	using TargetIterator = std::vector<Target>::iterator;
 	CallbackType callback;
+	//if set, lines are passed here in batches while downloading instead of to callback
+	CallbackType batch_callback;
+	//called once per target after its last batch
+	TargetDoneHandlerType target_done_handler;
+	//bytes of complete lines collected before a batch is parsed
+	std::size_t batch_size = 256 * 1024;
+	//if set, parsing and callbacks run here instead of on io_context threads,
+	//not owned since tasks keep the request alive, the pool must outlive every request
+	ComputePool * compute_pool = nullptr;
+	//lines per slice when a cached log is passed to batch_callback on compute_pool
+	std::size_t slice_lines = 16 * 1024;
 	ErrorHandlerType error_handler;
 	Log::ParserFunc parser;
 	std::string host;
 	std::string port;
 	std::vector<Target> targets;
+	std::shared_ptr<LogCache> cache;
+	//if set, targets are segments read from archiver instead of downloaded
+	std::shared_ptr<ChatArchiver> archiver;
+	//if set, downloaded logs are folded into rollups
+	std::shared_ptr<RollupStore> rollups;
+	std::size_t connections = 4;
+	//number of requests written ahead of responses per connection, 1 disables pipelining
+	std::size_t pipeline_depth = 1;
 	int version = 11;
 };
 
@@ -61,40 +93,220 @@ class LogDownloader : public std::enable_shared_from_this<LogDownloader>
 {
 public:
 	using HttpRequestType = boost::beast::http::request<boost::beast::http::empty_body>;
-	using HttpResponseType = boost::beast::http::response<boost::beast::http::string_body>;
-	using HttpResponseParserType = boost::beast::http::response_parser<boost::beast::http::string_body>;
+	using HttpResponseType = boost::beast::http::response<LineBody>;
+	using HttpResponseParserType = boost::beast::http::response_parser<LineBody>;
 
-	LogDownloader(boost::asio::io_context & ioc);
+	/*
+	Process wide limit of concurrent connections to one host.
+	Downloaders that find every slot taken wait for the next free one.
+	*/
+	static constexpr std::size_t max_connections_per_host = 8;
+
+	LogDownloader(std::shared_ptr<ConnectionPool> pool);
 
 	void run(LogRequest && request);
 
 private:
+	class Connection;
+	class TargetStream;
+
 	void errorHandler(boost::system::error_code ec);
 
-	void resolveHandler(boost::system::error_code ec, boost::asio::ip::tcp::resolver::results_type results);
+	/*
+	Deliver cached targets, then download the rest.
+	*/
+	void cacheHandler();
 
-	void connectHandler(boost::system::error_code ec);
+	/*
+	Deliver every target from archiver.
+	*/
+	void archiveHandler();
 
-	void handshakeHandler(boost::system::error_code ec);
+	/*
+	Start connections for targets not found in cache.
+	*/
+	void startConnections();
 
-	void writeHandler(boost::system::error_code ec, std::size_t bytes_transferred, LogRequest::TargetIterator it);
+	/*
+	Take next target from shared queue.
+	Return:
+		target if any left and no connection has failed
+		std::nullopt if not
+	*/
+	std::optional<LogRequest::TargetIterator> popTarget();
 
-	void readHandler(boost::system::error_code ec, std::size_t bytes_transferred, LogRequest::TargetIterator it);
+	/*
+	Put targets back in front of queue.
+	*/
+	void requeueTargets(const std::deque<LogRequest::TargetIterator> & targets);
 
-	void shutdownHandler(boost::system::error_code ec);
+	/*
+	Check if queue has targets left.
+	*/
+	bool hasTargets();
+
+	/*
+	Parse body, store in cache and rollups and pass log to callback.
+	*/
+	void deliver(LogRequest::TargetIterator it, std::string && data, bool cacheable);
+
+	/*
+	Pass cached log to batch_callback in slices of slice_lines lines, scanned
+	in parallel on compute_pool.
+	*/
+	void deliverSlices(TimeDetail::TimePeriod && period, Log::ChannelName && channel_name, std::shared_ptr<const LogArchive> archive);
 
-	void fillHttpRequest(const LogRequest::Target & target);
+	/*
+	Start one connection on a slot handed over by releaseConnection.
+	*/
+	void startQueuedConnection();
+
+	/*
+	Reserve up to wanted connection slots for host.
+	If no slot is free, downloader is queued and started on the next release.
+	Return:
+		number of slots granted
+	*/
+	static std::size_t acquireConnections(const std::string & host, std::size_t wanted, std::shared_ptr<LogDownloader> downloader);
+
+	/*
+	Hand slot to the first queued downloader of host, or free it.
+	*/
+	static void releaseConnection(const std::string & host);
 
+	std::shared_ptr<ConnectionPool> m_pool;
 	boost::asio::io_context & m_ioc;
-	boost::asio::ssl::context m_ctx;
-	boost::asio::ip::tcp::resolver m_resolver;
-	std::optional<boost::asio::ssl::stream<boost::asio::ip::tcp::socket>> m_stream;
+
+	std::mutex m_mutex;
+	std::size_t m_next_target = 0;
+	std::deque<LogRequest::TargetIterator> m_retry_targets;
+	bool m_failed = false;
+	LogRequest m_request;
+};
+
+/*
+One connection of a LogDownloader, downloads targets until the queue is empty.
+Up to pipeline_depth requests are written ahead of their responses, responses
+are read in request order. If the server closes a pipelined connection the
+unanswered targets are put back and a sequential connection takes over.
+*/
+class LogDownloader::Connection : public std::enable_shared_from_this<LogDownloader::Connection>
+{
+public:
+	Connection(std::shared_ptr<LogDownloader> downloader, std::size_t pipeline_depth);
+
+	void run();
+
+private:
+	void acquireHandler(boost::system::error_code ec, ConnectionPool::StreamPtr stream, bool reused);
+
+	/*
+	Queue requests until window is full, start write/read/shutdown as needed.
+	*/
+	void fillWindow();
+
+	void doWrite();
+
+	void writeHandler(boost::system::error_code ec, std::size_t bytes_transferred);
+
+	void doRead();
+
+	/*
+	Route body of response to a TargetStream.
+	*/
+	void headerHandler(boost::system::error_code ec, std::size_t bytes_transferred);
+
+	void readHandler(boost::system::error_code ec, std::size_t bytes_transferred);
+
+	/*
+	Hand unanswered targets back and continue on a new connection.
+	*/
+	void reconnect(std::size_t pipeline_depth);
+
+	/*
+	Retry on new connection if reused stream went stale or if pipelining,
+	else report error.
+	*/
+	void failureHandler(boost::system::error_code ec);
+
+	HttpRequestType createHttpRequest(const LogRequest::Target & target);
+
+	std::shared_ptr<LogDownloader> m_downloader;
+	const std::size_t m_pipeline_depth;
+	boost::asio::io_context::strand m_strand;
+	ConnectionPool::StreamPtr m_stream;
 	boost::beast::flat_buffer m_buffer;
-	HttpRequestType m_http_request;	
+	std::deque<HttpRequestType> m_write_queue;
+	std::deque<LogRequest::TargetIterator> m_in_flight;
 	std::optional<HttpResponseParserType> m_http_response_parser;
+	std::shared_ptr<TargetStream> m_target_stream;
+	bool m_writing = false;
+	bool m_reading = false;
+	bool m_closing = false;
+	bool m_reused = false;
+	bool m_got_response = false;
+};
 
-	std::mutex m_read_handler_mutex;
-	LogRequest m_request;
+/*
+Receives the body of one target from LineBody.
+With batch_callback set every chunk is parsed and passed on right away,
+else the body is collected and delivered as one Log.
+With compute_pool set chunks are parsed in parallel on the pool, parsed
+chunks are appended to the cache writer in body order, to the rollup writer
+in any order, and
+target_done_handler is called once every chunk has been passed on.
+*/
+class LogDownloader::TargetStream : public std::enable_shared_from_this<LogDownloader::TargetStream>
+{
+public:
+	TargetStream(std::shared_ptr<LogDownloader> downloader, LogRequest::TargetIterator it, bool cacheable);
+
+	void write(std::string && chunk);
+
+	void finish();
+
+	/*
+	Target can be downloaded again without passing lines on twice.
+	*/
+	bool isRetryable() const;
+
+private:
+	/*
+	Parse chunk number index and pass it, and any later chunks waiting for
+	it, on.
+	*/
+	void processBatch(std::size_t index, std::string & chunk);
+
+	/*
+	Commit cache and rollups and report target done.
+	*/
+	void complete();
+
+	/*
+	Run task on compute pool if there is one, else right away.
+	*/
+	void dispatch(ComputePool::TaskType task);
+
+	std::shared_ptr<LogDownloader> m_downloader;
+	LogRequest::TargetIterator m_it;
+	bool m_cacheable;
+	bool m_batched;
+	bool m_written = false;
+	std::string m_data;
+	//chunks written, only touched by the connection
+	std::size_t m_batches_written = 0;
+
+	std::mutex m_mutex;
+	bool m_valid = true;
+	std::unique_ptr<LogCache::Writer> m_cache_writer;
+	std::unique_ptr<RollupStore::Writer> m_rollup_writer;
+	//index of next chunk to append to cache writer
+	std::size_t m_next_append = 0;
+	//parsed chunks waiting for an earlier chunk
+	std::map<std::size_t, Log> m_parsed;
+	//chunks not yet passed to batch_callback
+	std::size_t m_pending = 0;
+	bool m_finished = false;
 };
 
 /*
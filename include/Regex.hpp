@@ -0,0 +1,145 @@
+//Regex.hpp
+#pragma once
+#ifndef Regex_HEADER
+#define Regex_HEADER
+
+//C++
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <stdexcept>
+#include <cstdint>
+
+//local
+#include "SubstringSearcher.hpp"
+
+/*
+Regex compiled to a program for a Pike VM, every search is linear in the
+length of the input and uses no recursion, so hostile patterns can not pin
+a thread or overflow the stack.
+Supported (ECMAScript subset):
+	literals, escapes, . [...] [^...] \d \D \w \W \s \S \b \B ^ $
+	( ) (?: ) | * + ? {n} {n,} {n,m} and lazy forms *? +? ?? {..}?
+Backreferences and lookaround are not supported.
+Matching is leftmost-first like std::regex, ^ and $ match at start and end
+of input only.
+If the pattern starts with a literal, the literal is found with
+SubstringSearcher before the VM runs.
+*/
+class Regex
+{
+public:
+	/*
+	Limits for untrusted patterns.
+	*/
+	static constexpr std::size_t max_pattern_size = 1024;
+	static constexpr std::size_t max_program_size = 16 * 1024;
+	//nodes visited while compiling, repeats of empty nodes emit nothing
+	static constexpr std::size_t max_compile_work = 64 * 1024;
+	static constexpr int max_repeat = 1000;
+
+	//[begin, end) of match
+	using Match = std::pair<std::size_t, std::size_t>;
+
+	/*
+	Compile pattern.
+	Throw:
+		std::runtime_error if pattern is invalid, unsupported or too large
+	*/
+	Regex(std::string_view pattern, bool caseless = false);
+
+	/*
+	Compile pattern or take it from cache of recently used patterns.
+	Throw:
+		std::runtime_error if pattern is invalid, unsupported or too large
+	*/
+	static std::shared_ptr<const Regex> compile(std::string_view pattern, bool caseless = false);
+
+	/*
+	Find leftmost match starting at or after pos.
+	*/
+	std::optional<Match> search(std::string_view str, std::size_t pos = 0) const;
+
+	/*
+	Check if whole str matches.
+	*/
+	bool fullMatch(std::string_view str) const;
+
+	/*
+	Count non-overlapping matches, empty matches advance by one.
+	*/
+	std::size_t count(std::string_view str) const;
+
+private:
+	enum class Op : std::uint8_t
+	{
+		byte_class,		//consume byte in m_classes[x]
+		split,			//try x, then y
+		jump,			//go to x
+		line_begin,
+		line_end,
+		word_boundary,
+		not_word_boundary,
+		match
+	};
+
+	struct Inst
+	{
+		Op op;
+		std::uint32_t x = 0;
+		std::uint32_t y = 0;
+	};
+
+	using ByteClass = std::array<std::uint64_t, 4>;
+
+	struct Node;
+	class Parser;
+
+	static bool classHas(const ByteClass & c, unsigned char b)
+	{
+		return (c[b >> 6] >> (b & 63)) & 1;
+	}
+
+	static bool isWordByte(unsigned char b);
+
+	/*
+	Append literal bytes at start of node.
+	Return:
+		true if node is literal as a whole
+	*/
+	static bool collectLiteralPrefix(const Node & node, std::string & prefix);
+
+	/*
+	Throw:
+		std::runtime_error if compile work or program size exceeds its limit
+	*/
+	void compileNode(const Node & node);
+
+	std::uint32_t emit(Op op, std::uint32_t x = 0, std::uint32_t y = 0);
+
+	std::uint32_t addClass(const ByteClass & c);
+
+	/*
+	Run VM from pos.
+	anchored: only threads starting at pos
+	full: accept match only at end of str
+	*/
+	std::optional<Match> run(std::string_view str, std::size_t pos, bool anchored, bool full) const;
+
+	std::vector<Inst> m_program;
+	std::vector<ByteClass> m_classes;
+	std::size_t m_compile_work = 0;
+	//pattern is a plain literal, VM is not needed
+	bool m_literal = false;
+	std::size_t m_literal_size = 0;
+	std::optional<SubstringSearcher> m_prefix_searcher;
+};
+
+#endif // !Regex_HEADER
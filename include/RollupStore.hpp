@@ -0,0 +1,204 @@
+//RollupStore.hpp
+#pragma once
+#ifndef RollupStore_HEADER
+#define RollupStore_HEADER
+
+//C++
+#include <string>
+#include <string_view>
+#include <optional>
+#include <unordered_map>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <memory>
+#include <cstdint>
+
+//Date
+#include <date/date.h>
+
+//local
+#include "TimeDetail.hpp"
+#include "Log.hpp"
+#include "TokenIndex.hpp"
+
+/*
+In-memory per (channel, user, day) rollup of line and token counts.
+Downloaded logs are folded in by a Writer, live chat by addLive. A user day
+holds a base record from the latest download, complete until a cutoff, and
+live records in hourly buckets from the cutoff on, so no line is counted
+twice. Base records keep the max_tokens most frequent tokens, counted
+exactly, live records keep every token.
+Channel and user names are caseless, a leading '#' of a channel is ignored.
+Tokens are TokenIndex tokens.
+Every channel has its own lock, lines are tokenized before it is taken.
+*/
+class RollupStore
+{
+public:
+	using Duration = std::chrono::system_clock::duration;
+
+	/*
+	max_tokens: tokens kept per base record
+	retention: days older than this are dropped
+	log_delay: lines newer than this at download time may be missing from the log
+	*/
+	RollupStore(std::size_t max_tokens = 64, Duration retention = date::days(62), Duration log_delay = std::chrono::minutes(1));
+
+	class Writer;
+
+	/*
+	Start folding in a downloaded log of channel, period must be day aligned.
+	user: owner of a user log, empty for a channel log
+	*/
+	std::unique_ptr<Writer> createWriter(std::string_view channel, const TimeDetail::TimePeriod & period, std::string_view user);
+
+	/*
+	Add live line.
+	Only counted if the channel is tracked, see setLiveSince.
+	*/
+	void addLive(std::string_view channel, std::string_view user, TimeDetail::TimePoint time, std::string_view message);
+
+	/*
+	Every line of channel from time on is passed to addLive.
+	*/
+	void setLiveSince(std::string_view channel, TimeDetail::TimePoint time);
+
+	/*
+	Stop tracking channel.
+	*/
+	void clearLive(std::string_view channel);
+
+	/*
+	Stop tracking every channel.
+	*/
+	void clearLive();
+
+	/*
+	Count occurrences of token in lines of user in channel within period.
+	period.begin must be day aligned, period.end day aligned or in the future.
+	Return:
+		count if every day of period up to now is covered
+		std::nullopt if not
+	*/
+	std::optional<std::uint64_t> countToken(std::string_view channel, std::string_view user, const TimeDetail::TimePeriod & period, std::string_view token);
+
+private:
+	struct Record
+	{
+		std::uint64_t lines = 0;
+		std::unordered_map<std::string, std::uint64_t> tokens;
+		//tokens left out, absent tokens are unknown
+		bool truncated = false;
+
+		void add(std::string_view message, std::string & scratch);
+
+		/*
+		Add counts of other, other is left unspecified.
+		*/
+		void merge(Record && other);
+
+		/*
+		Keep the max_tokens most frequent tokens.
+		*/
+		void trim(std::size_t max_tokens);
+
+		/*
+		Return:
+			count if known
+			std::nullopt if not
+		*/
+		std::optional<std::uint64_t> count(const std::string & token) const;
+	};
+
+	struct UserDay
+	{
+		Record base;
+		//lines before this are in base
+		TimeDetail::TimePoint base_until;
+		//lines from base_until on, by hour
+		std::map<TimeDetail::TimePoint, Record> live;
+	};
+
+	struct Day
+	{
+		//users missing from users have no lines before this
+		TimeDetail::TimePoint base_until;
+		std::unordered_map<std::string, UserDay> users;
+	};
+
+	struct Channel
+	{
+		std::mutex mutex;
+		//ordered so pruning takes from the front
+		std::map<date::sys_days, Day> days;
+		std::optional<TimeDetail::TimePoint> live_since;
+	};
+
+	static std::string normalizeName(std::string_view name);
+
+	/*
+	Entry of channel, created if missing, entries are never removed.
+	*/
+	Channel & getChannel(const std::string & channel);
+
+	/*
+	Entry of user, created with the base of the day.
+	*/
+	static UserDay & getUserDay(Day & day, const std::string & user);
+
+	/*
+	Replace base of user day with record complete until cutoff.
+	*/
+	static void replaceBase(UserDay & user_day, Record && record, TimeDetail::TimePoint cutoff);
+
+	/*
+	Must hold channel.mutex.
+	*/
+	void prune(Channel & channel, TimeDetail::TimePoint now);
+
+	const std::size_t m_max_tokens;
+	const Duration m_retention;
+	const Duration m_log_delay;
+	//only guards m_channels, not the entries
+	std::mutex m_mutex;
+	std::unordered_map<std::string, std::unique_ptr<Channel>> m_channels;
+};
+
+/*
+Fold in one downloaded log, nothing is visible in the store until commit.
+Lines at or after the cutoff taken at creation are left to live tracking.
+Must not outlive the RollupStore.
+*/
+class RollupStore::Writer
+{
+public:
+	/*
+	Append batch of lines, batches may come in any order.
+	*/
+	void append(const Log & log);
+
+	/*
+	Replace the covered days of the store.
+	*/
+	void commit();
+
+private:
+	friend class RollupStore;
+
+	Writer(RollupStore & store, std::string && channel, std::string && user, TimeDetail::TimePoint begin, TimeDetail::TimePoint until);
+
+	RollupStore & m_store;
+	std::string m_channel;
+	std::string m_user;
+	//lines in [m_begin, m_until) are folded in
+	TimeDetail::TimePoint m_begin;
+	TimeDetail::TimePoint m_until;
+	std::map<date::sys_days, std::unordered_map<std::string, Record>> m_days;
+	std::string m_token; //reused by append
+	std::string m_name; //reused by append
+};
+
+#endif // !RollupStore_HEADER
@@ -23,7 +23,6 @@
 #include <unordered_set>
 #include <unordered_map>
 #include <charconv>
-#include <regex>
 #include <set>
 
 //Date
@@ -40,6 +39,16 @@
 
 //Local
 #include "IRCMessage.hpp"
+#include "IRCLineFramer.hpp"
+#include "CaselessPerfectHash.hpp"
+#include "SubstringSearcher.hpp"
+#include "Regex.hpp"
+#include "AhoCorasick.hpp"
+#include "TokenIndex.hpp"
+#include "ConnectionPool.hpp"
+#include "ComputePool.hpp"
+#include "RollupStore.hpp"
+#include "ChatArchiver.hpp"
 #include "LogDownloader.hpp"
 #include "DankHttp.hpp"
 #include "IRCMessageBuffer.hpp"
@@ -52,7 +61,7 @@ struct CommandContainer
 	using FuncType = std::function<void(const IRCMessage&, std::string_view)>;
 
 	CommandContainer(
-		const std::string & command,
+		std::string_view command,
 		const std::string & arguments,
 		const std::string & description,
 		const FuncType & func
@@ -69,6 +78,21 @@ struct CommandContainer
 	const FuncType m_func;
 };
 
+/*
+Per channel state.
+Messages for a channel are handled in arrival order on the channel strand.
+*/
+struct ChannelShard
+{
+	ChannelShard(boost::asio::io_context & ioc, std::size_t buffer_size) :
+		m_strand(ioc),
+		m_buffer(buffer_size)
+	{
+	}
+	boost::asio::io_context::strand m_strand;
+	IRCMessageBuffer m_buffer;
+};
+
 class SaivBot
 {
 public:
@@ -133,6 +157,17 @@ private:
 	*/
 	void consumeMsgBuffer();
 
+	/*
+	Post batched PRIVMSGs to their channel strands.
+	*/
+	void postShardBatches();
+
+	/*
+	Handle PRIVMSG, runs on channel strand.
+	Commands are posted to read strand.
+	*/
+	void handlePRIVMSG(const IRCMessage & msg);
+
 	/*
 	*/
 	void parseFreeMessage(const IRCMessage & msg);
@@ -203,18 +238,20 @@ private:
 	boost::asio::system_timer m_send_message_timer;
 
 	static const std::size_t m_buffer_size = 10000;
-	std::array<char, m_buffer_size> m_recv_buffer;
+	IRCLineFramer m_framer;
+	std::vector<std::string_view> m_framed_lines;
 
-	std::string m_buffer;
 	std::deque<IRCMessage> m_msg_pre_buffer;
 
 	const std::size_t m_message_buffer_size = 1000;
-	using ChannelData = std::tuple<std::unique_ptr<IRCMessageBuffer>>;
+	using ChannelData = std::shared_ptr<ChannelShard>;
 	std::unordered_map<std::string, ChannelData> m_channels;
+	std::vector<std::pair<ChannelData, std::vector<IRCMessage>>> m_shard_batches;
 	
 	std::string m_host;
 	std::string m_port;
 	std::string m_nick;
+	std::string m_nick_lower;
 	std::string m_password;
 
 	TimeDetail::TimePoint m_time_started;
@@ -222,6 +259,31 @@ private:
 	std::unordered_set<std::string> m_whitelist;
 	std::unordered_set<std::string> m_modlist;
 
+	const std::uintmax_t m_log_cache_max_size = 1024ull * 1024ull * 1024ull;
+	const std::chrono::system_clock::duration m_log_cache_ttl = std::chrono::minutes(10);
+	//index tokens of cached logs so -word -caseless queries skip message text
+	const bool m_log_cache_token_index = true;
+	std::shared_ptr<LogCache> m_log_cache;
+
+	//requests written ahead of responses per log connection, 1 disables pipelining (config "log_pipeline_depth")
+	std::size_t m_log_pipeline_depth = 1;
+
+	//keep-alive TLS connections shared by all outbound https requests
+	std::shared_ptr<ConnectionPool> m_connection_pool;
+
+	//log parsing and scanning, keeps io_context threads free for network
+	std::unique_ptr<ComputePool> m_compute_pool;
+
+	//line and token counts of downloaded logs and live chat, answers count without downloading
+	std::shared_ptr<RollupStore> m_rollup_store;
+
+	//archive every PRIVMSG of joined channels (config "chat_archive"), off by default
+	bool m_chat_archive = false;
+	//days of segments kept (config "chat_archive_retention_days")
+	int m_chat_archive_retention_days = 30;
+	//read by the local log service, null if archiving is off
+	std::shared_ptr<ChatArchiver> m_chat_archiver;
+
 	/*
 	Bind command
 	*/
@@ -251,6 +313,46 @@ private:
 		NUMBER_OF_COMMANDS
 	};
 
+	/*
+	Command names, indexed by Commands.
+	*/
+	static constexpr std::array<std::string_view, Commands::NUMBER_OF_COMMANDS> m_command_names
+	{
+		"shutdown",
+		"help",
+		"count",
+		"find",
+		"clip",
+		"promote",
+		"demote",
+		"join",
+		"part",
+		"uptime",
+		"say",
+		"ping",
+		"commands",
+		"flags",
+		"test_insertmessage"
+	};
+
+	static constexpr CaselessPerfectHash<Commands::NUMBER_OF_COMMANDS> m_command_hash{ m_command_names };
+
+	/*
+	Find command by name (caseless).
+	Return:
+		pointer to command container
+		nullptr if not found
+	*/
+	const CommandContainer * findCommand(std::string_view name) const;
+
+	/*
+	Check if message body is addressed to bot, "<nick> <command> ...".
+	Return:
+		body after nick with leading spaces removed
+		std::nullopt if body does not start with nick
+	*/
+	std::optional<std::string_view> stripNickPrefix(std::string_view body) const;
+
 	/*
 	Command functions.
 	*/
@@ -272,26 +374,34 @@ private:
 
 	const std::array<CommandContainer, static_cast<std::size_t>(Commands::NUMBER_OF_COMMANDS)> m_command_containers
 	{
-		CommandContainer("shutdown", "", "Orderly shut down execution and save config.", bindCommand(&SaivBot::shutdownCommandFunc)),
-		CommandContainer("help", "<command>", "Get info about command.", bindCommand(&SaivBot::helpCommandFunc)),
-		CommandContainer("count", "<target> [-flag1 [param ...] -flag2 [param ...] ...]", "Count the occurrences of target in logs.", bindCommand(&SaivBot::countCommandFunc)),
+		CommandContainer(m_command_names[Commands::shutdown], "", "Orderly shut down execution and save config.", bindCommand(&SaivBot::shutdownCommandFunc)),
+		CommandContainer(m_command_names[Commands::help_command], "<command>", "Get info about command.", bindCommand(&SaivBot::helpCommandFunc)),
+		CommandContainer(m_command_names[Commands::count_command], "<target | list of targets> [-flag1 [param ...] -flag2 [param ...] ...]", "Count the occurrences of each target in logs.", bindCommand(&SaivBot::countCommandFunc)),
 		//CommandContainer("search", "<target> [-flag1 [param ...] -flag2 [param ...] ...]", "Search for target in logs", bindCommand(&SaivBot::searchCommandFunc)),
-		CommandContainer("find", "<target> [-flag1 [param ...] -flag2 [param ...] ...]", "Find all lines containing target in logs.", bindCommand(&SaivBot::findCommandFunc)),
+		CommandContainer(m_command_names[Commands::find_command], "<target | list of targets> [-flag1 [param ...] -flag2 [param ...] ...]", "Find all lines containing any target in logs.", bindCommand(&SaivBot::findCommandFunc)),
 		//CommandContainer("regexfind", "<regex> [-flag1 [param ...] -flag2 [param ...] ...]", "Find regex matches in logs.", bindCommand(&SaivBot::regexfindCommandFunc)),
-		CommandContainer("clip", "[-flag1 [param ...] -flag2 [param ...] ...]", "Capture a snapshot of chat.", bindCommand(&SaivBot::clipCommandFunc)),
-		CommandContainer("promote", "<user>", "Whitelist user.", bindCommand(&SaivBot::promoteCommandFunc)),
-		CommandContainer("demote", "<user>", "Remove user from whitelist.", bindCommand(&SaivBot::demoteCommandFunc)),
-		CommandContainer("join", "<channel>", "Join channel.", bindCommand(&SaivBot::joinCommandFunc)),
-		CommandContainer("part", "<channel>", "Part channel.", bindCommand(&SaivBot::partCommandFunc)),
-		CommandContainer("uptime", "", "Get uptime.", bindCommand(&SaivBot::uptimeCommandFunc)),
-		CommandContainer("say", "<stuff to say>", "Make bot say something.", bindCommand(&SaivBot::sayCommandFunc)),
-		CommandContainer("ping", "", "Ping the bot", bindCommand(&SaivBot::pingCommandFunc)),
-		CommandContainer("commands", "", "Get link to commands doc.", bindCommand(&SaivBot::commandsCommandFunc)),
-		CommandContainer("flags", "", "Get link to flags doc.", bindCommand(&SaivBot::flagsCommandFunc)),
-		CommandContainer("test_insertmessage", "<string>", "insert IRCMessage in receive queue.", bindCommand(&SaivBot::test_insertmessageCommandFunc))
+		CommandContainer(m_command_names[Commands::clip_command], "[-flag1 [param ...] -flag2 [param ...] ...]", "Capture a snapshot of chat.", bindCommand(&SaivBot::clipCommandFunc)),
+		CommandContainer(m_command_names[Commands::promote_command], "<user>", "Whitelist user.", bindCommand(&SaivBot::promoteCommandFunc)),
+		CommandContainer(m_command_names[Commands::demote_command], "<user>", "Remove user from whitelist.", bindCommand(&SaivBot::demoteCommandFunc)),
+		CommandContainer(m_command_names[Commands::join_command], "<channel>", "Join channel.", bindCommand(&SaivBot::joinCommandFunc)),
+		CommandContainer(m_command_names[Commands::part_command], "<channel>", "Part channel.", bindCommand(&SaivBot::partCommandFunc)),
+		CommandContainer(m_command_names[Commands::uptime_command], "", "Get uptime.", bindCommand(&SaivBot::uptimeCommandFunc)),
+		CommandContainer(m_command_names[Commands::say_command], "<stuff to say>", "Make bot say something.", bindCommand(&SaivBot::sayCommandFunc)),
+		CommandContainer(m_command_names[Commands::ping_command], "", "Ping the bot", bindCommand(&SaivBot::pingCommandFunc)),
+		CommandContainer(m_command_names[Commands::commands_command], "", "Get link to commands doc.", bindCommand(&SaivBot::commandsCommandFunc)),
+		CommandContainer(m_command_names[Commands::flags_command], "", "Get link to flags doc.", bindCommand(&SaivBot::flagsCommandFunc)),
+		CommandContainer(m_command_names[Commands::test_insertmessage_command], "<string>", "insert IRCMessage in receive queue.", bindCommand(&SaivBot::test_insertmessageCommandFunc))
 	};
 
-	void fillLogRequestTargetFields(
+	/*
+	Fill host, parser, cache and targets of log_request.
+	Only logs overlapping period are targeted. Without all_users the cheaper
+	of per user month logs and channel day logs is chosen by estimated
+	bytes to download. The local service always reads channel day segments.
+	Return:
+		true if targets are channel logs and lines must be filtered by users
+	*/
+	bool fillLogRequestTargetFields(
 		LogRequest & log_request,
 		const LogService service,
 		const bool all_users,
@@ -300,33 +410,38 @@ private:
 		const std::vector<std::string_view> & users
 	)
 	{
-		auto generate_year_month_user_list = [&period, &channels, &users, this](auto func) -> std::vector<LogRequest::Target> {
-			auto year_months = periodToYearMonths(period);
+		auto year_months = periodToYearMonths(period);
+		auto dates = periodToDates(period);
+		auto generate_year_month_user_list = [&year_months, &channels, &users](auto func) -> std::vector<LogRequest::Target> {
 			std::vector<LogRequest::Target> vec;
 			for (auto & channel : channels) {
 				for (auto & user : users) {
 					for (auto & ym : year_months) {
-						vec.emplace_back(TimeDetail::createYearMonthPeriod(ym), channel, func(channel, user, ym));
+						vec.emplace_back(TimeDetail::createYearMonthPeriod(ym), channel, func(channel, user, ym), user);
 					}
 				}
 			}
 			return vec;
 		};
-		auto generate_date_list = [&period, &channels, this](auto func) -> std::vector<LogRequest::Target> {
-			auto dates = periodToDates(period);
+		auto generate_date_list = [&dates, &channels](auto func) -> std::vector<LogRequest::Target> {
 			std::vector<LogRequest::Target> vec;
 			for (auto & channel : channels) {
 				for (auto & date : dates) {
-					vec.emplace_back(TimeDetail::createYearMonthDayPeriod(date), channel, func(channel, date));
+					vec.emplace_back(TimeDetail::createYearMonthDayPeriod(date), channel, func(channel, date), std::string());
 				}
 			}
 			return vec;
 		};
+		bool channel_logs = all_users || service == LogService::local_log || preferChannelLogs(users.size(), year_months.size(), dates.size());
+		log_request.cache = m_log_cache;
+		log_request.compute_pool = m_compute_pool.get();
+		log_request.rollups = m_rollup_store;
+		log_request.pipeline_depth = m_log_pipeline_depth;
 		if (service == LogService::gempir_log) {
 			log_request.parser = gempirLogParser;
 			log_request.host = "api.gempir.com";
 			log_request.port = "443";
-			if (!all_users) {
+			if (!channel_logs) {
 				log_request.targets = generate_year_month_user_list(createGempirUserTarget);
 			}
 			else {
@@ -337,26 +452,49 @@ private:
 			log_request.parser = overrustleLogParser;
 			log_request.host = "overrustlelogs.net";
 			log_request.port = "443";
-			if (!all_users) {
+			//rollups only hold gempir logs
+			log_request.rollups = nullptr;
+			if (!channel_logs) {
 				log_request.targets = generate_year_month_user_list(createOverrustleUserTarget);
 			}
 			else {
 				log_request.targets = generate_date_list(createOverrustleChannelTarget);
 			}
 		}
+		else if (service == LogService::local_log) {
+			//segments are per channel and day and never leave the box
+			log_request.parser = gempirLogParser;
+			log_request.archiver = m_chat_archiver;
+			log_request.cache = nullptr;
+			log_request.rollups = nullptr;
+			log_request.targets = generate_date_list(ChatArchiver::createSegmentName);
+		}
 		else {
 			assert(false);
-		}	
+		}
+		return channel_logs && !all_users;
 	}
 
+	/*
+	Shared between the download workers of one count command.
+	Workers add their per log counts with atomics, the last target to finish
+	sends the reply.
+	*/
 	struct CountCallbackSharedData
 	{
-		std::mutex mutex;
-		std::size_t reference_count;
-		std::function<std::size_t(std::string_view)> count_func;
+		std::atomic<std::size_t> reference_count;
+		//set by whoever replies first, result or error
+		std::atomic<bool> replied = false;
+		//add occurrences in message to counts[target index]
+		std::function<void(std::string_view, std::vector<std::size_t>&)> count_func;
+		//if set, only lines with a name it accepts are searched
+		std::function<bool(std::string_view)> user_filter;
+		//lowercase whole token targets, if set logs with a token index are counted from it
+		std::vector<std::string> index_tokens;
 		TimeDetail::TimePeriod period;
 		IRCMessage irc_msg;
-		std::size_t shared_count;
+		std::vector<std::string> targets;
+		std::vector<std::atomic<std::size_t>> shared_count;
 	};
 
 	void countCommandCallback(
@@ -364,12 +502,17 @@ private:
 		std::shared_ptr<CountCallbackSharedData> shared_data_ptr
 	)
 	{
-		std::size_t count = 0;
+		if (shared_data_ptr->replied.load(std::memory_order_relaxed)) return;
+		std::vector<std::size_t> counts(shared_data_ptr->targets.size(), 0);
 		try {
-			if (log.isValid()) {
-				for (auto & line : log.getLines()) {
-					if (shared_data_ptr->period.isInside(line.getTime())) {
-						count += shared_data_ptr->count_func(line.getMessageView());
+			bool indexed = !shared_data_ptr->index_tokens.empty() && log.isValid() && countFromTokenIndex(log, *shared_data_ptr, counts);
+			if (!indexed && log.isValid()) {
+				auto [first, last] = log.getLineRange(shared_data_ptr->period);
+				bool sorted = log.isSorted();
+				for (std::size_t i = first; i < last; ++i) {
+					if (shared_data_ptr->user_filter && !shared_data_ptr->user_filter(log.getName(i))) continue;
+					if (sorted || shared_data_ptr->period.isInside(log.getTime(i))) {
+						shared_data_ptr->count_func(log.getMessage(i), counts);
 					}
 				}
 			}
@@ -377,22 +520,97 @@ private:
 		catch (std::exception)
 		{
 		}
-		std::lock_guard<std::mutex> lock(shared_data_ptr->mutex);
-		if (shared_data_ptr->reference_count > 0) {
-			shared_data_ptr->shared_count += count;
-			--shared_data_ptr->reference_count;
-			if (shared_data_ptr->reference_count <= 0) {
-				std::stringstream reply;
-				reply << shared_data_ptr->irc_msg.getNick() << ", count: " << shared_data_ptr->shared_count;
-				sendPRIVMSG(shared_data_ptr->irc_msg.getParams()[0], reply.str());
+		for (std::size_t i = 0; i < counts.size(); ++i) {
+			if (counts[i] > 0) {
+				shared_data_ptr->shared_count[i].fetch_add(counts[i], std::memory_order_relaxed);
+			}
+		}
+	}
+
+	/*
+	Count index_tokens with token index of log, no message is read.
+	Return:
+		false if log has no token index
+	*/
+	bool countFromTokenIndex(const Log & log, const CountCallbackSharedData & shared_data, std::vector<std::size_t> & counts)
+	{
+		const TokenIndex * index = log.getTokenIndex();
+		if (!index) return false;
+		auto [first, last] = log.getLineRange(shared_data.period);
+		bool sorted = log.isSorted();
+		std::size_t base = log.getArchiveFirst();
+		//every indexed line counts, posting list length is the answer
+		bool whole = sorted && !shared_data.user_filter && base == 0 && first == 0 && last == index->getNumberOfLines();
+		for (std::size_t t = 0; t < shared_data.index_tokens.size(); ++t) {
+			auto postings = index->find(shared_data.index_tokens[t]);
+			if (!postings) continue;
+			if (whole) {
+				counts[t] += static_cast<std::size_t>(postings->size());
+				continue;
+			}
+			postings->forEach(base + first, base + last, [&](std::uint64_t line_id) {
+				std::size_t i = static_cast<std::size_t>(line_id - base);
+				if (shared_data.user_filter && !shared_data.user_filter(log.getName(i))) return;
+				if (sorted || shared_data.period.isInside(log.getTime(i))) ++counts[t];
+			});
+		}
+		return true;
+	}
+
+	void countCommandTargetDoneHandler(std::shared_ptr<CountCallbackSharedData> shared_data_ptr)
+	{
+		//acq_rel so the last target sees every count added before the others finished
+		if (shared_data_ptr->reference_count.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+		if (shared_data_ptr->replied.exchange(true)) return;
+		std::vector<std::size_t> counts(shared_data_ptr->shared_count.begin(), shared_data_ptr->shared_count.end());
+		sendPRIVMSG(shared_data_ptr->irc_msg.getParams()[0], formatCountReply(shared_data_ptr->irc_msg.getNick(), shared_data_ptr->targets, counts));
+	}
+
+	static std::string formatCountReply(std::string_view nick, const std::vector<std::string> & targets, const std::vector<std::size_t> & counts)
+	{
+		std::stringstream reply;
+		reply << nick << ", count: ";
+		if (targets.size() == 1) {
+			reply << counts.front();
+		}
+		else {
+			for (std::size_t i = 0; i < targets.size(); ++i) {
+				reply << (i > 0 ? ", " : "") << targets[i] << ": " << counts[i];
+			}
+		}
+		return reply.str();
+	}
+
+	/*
+	Whole word caseless count of targets by users in channels, summed from
+	rollups of gempir logs and live chat.
+	Return:
+		counts if every day of period is covered for every channel and user
+		std::nullopt if not
+	*/
+	std::optional<std::vector<std::size_t>> countFromRollups(
+		const std::vector<std::string_view> & channels,
+		const std::vector<std::string_view> & users,
+		const TimeDetail::TimePeriod & period,
+		const std::vector<std::string> & targets
+	)
+	{
+		std::vector<std::size_t> counts(targets.size());
+		for (auto & channel : channels) {
+			for (auto & user : users) {
+				for (std::size_t i = 0; i < targets.size(); ++i) {
+					auto count = m_rollup_store->countToken(channel, user, period, targets[i]);
+					if (!count) return std::nullopt;
+					counts[i] += static_cast<std::size_t>(*count);
+				}
 			}
 		}
+		return counts;
 	}
 
 	void countCommandErrorHandler(std::shared_ptr<CountCallbackSharedData> shared_data_ptr)
 	{
-		std::lock_guard<std::mutex> lock(shared_data_ptr->mutex);
-		shared_data_ptr->reference_count = 0;
+		if (shared_data_ptr->replied.exchange(true)) return;
 		std::stringstream reply;
 		reply
 			<< shared_data_ptr->irc_msg.getNick()
@@ -401,18 +619,94 @@ private:
 		replyToIRCMessage(shared_data_ptr->irc_msg, reply.str());
 	}
 
+	/*
+	Shared between the download workers of one find command.
+	Every parsed batch that has hits is kept alive as a run holding the Log
+	and the indices of its matching lines, runs are published on a lock free
+	stack. Runs are time sorted so the last target to finish k-way merges
+	them into line references instead of sorting copies of every line.
+	*/
 	struct FindCallbackSharedData
 	{
-		using ChannelSet = std::set<Log::ChannelName>;
-		using SharedLinesFound = std::vector<std::tuple<ChannelSet::const_iterator, Log::Line>>;
-		std::mutex mutex;
-		std::size_t reference_count;
+		//line index in a run's log
+		using LineRef = std::pair<const Log*, std::size_t>;
+		using SharedLinesFound = std::vector<LineRef>;
+
+		struct Run
+		{
+			std::shared_ptr<const Log> log;
+			std::vector<std::size_t> lines;
+			Run * next = nullptr;
+		};
+
+		~FindCallbackSharedData()
+		{
+			Run * run = runs.load();
+			while (run) {
+				Run * next = run->next;
+				delete run;
+				run = next;
+			}
+		}
+
+		void pushRun(std::shared_ptr<const Log> log, std::vector<std::size_t> && lines)
+		{
+			Run * run = new Run{ std::move(log), std::move(lines) };
+			run->next = runs.load(std::memory_order_relaxed);
+			while (!runs.compare_exchange_weak(run->next, run, std::memory_order_release, std::memory_order_relaxed));
+		}
+
+		/*
+		Merge all runs into one time sorted sequence of line references,
+		references are valid as long as this is alive.
+		Must only be called once every worker is done.
+		*/
+		SharedLinesFound mergeRuns() const
+		{
+			std::vector<const Run*> sources;
+			std::size_t total = 0;
+			for (const Run * run = runs.load(std::memory_order_acquire); run; run = run->next) {
+				sources.push_back(run);
+				total += run->lines.size();
+			}
+			SharedLinesFound merged;
+			merged.reserve(total);
+			//min heap of (source, position) on line time
+			using Cursor = std::pair<std::size_t, std::size_t>;
+			auto time_of = [&sources](const Cursor & c) {
+				return sources[c.first]->log->getTime(sources[c.first]->lines[c.second]);
+			};
+			auto later = [&time_of](const Cursor & a, const Cursor & b) {
+				return time_of(a) > time_of(b);
+			};
+			std::priority_queue<Cursor, std::vector<Cursor>, decltype(later)> heap(later);
+			for (std::size_t i = 0; i < sources.size(); ++i) {
+				heap.emplace(i, 0);
+			}
+			while (!heap.empty()) {
+				auto [source, pos] = heap.top();
+				heap.pop();
+				merged.emplace_back(sources[source]->log.get(), sources[source]->lines[pos]);
+				if (pos + 1 < sources[source]->lines.size()) {
+					heap.emplace(source, pos + 1);
+				}
+			}
+			return merged;
+		}
+
+		std::atomic<std::size_t> reference_count;
+		//set by whoever replies first, result or error
+		std::atomic<bool> replied = false;
 		std::function<bool(std::string_view)> find_func;
-		std::function<std::string(SharedLinesFound&)> dump_func;
+		//if set, only lines with a name it accepts are searched
+		std::function<bool(std::string_view)> user_filter;
+		//lowercase whole token targets, if set logs with a token index are searched with it
+		std::vector<std::string> index_tokens;
+		//append formatted line to buffer
+		std::function<void(const LineRef&, std::string&)> dump_func;
 		TimeDetail::TimePeriod period;
 		IRCMessage irc_msg;
-		SharedLinesFound shared_lines_found;
-		ChannelSet channels;
+		std::atomic<Run*> runs = nullptr;
 	};
 
 	void findCommandCallback(
@@ -420,16 +714,18 @@ private:
 		std::shared_ptr<FindCallbackSharedData> shared_data_ptr
 	)
 	{
-		FindCallbackSharedData::SharedLinesFound lines_found;
+		if (shared_data_ptr->replied.load(std::memory_order_relaxed)) return;
+		std::vector<std::size_t> lines_found;
 		try {
-			if (log.isValid()) {
-				//find ChannelName ptr
-				auto it = shared_data_ptr->channels.find(log.getChannelName());
-				assert(it != shared_data_ptr->channels.end());
-				for (auto & line : log.getLines()) {
-					if (shared_data_ptr->period.isInside(line.getTime())) {
-						if (shared_data_ptr->find_func(line.getMessageView())) {
-							lines_found.emplace_back(it, line);
+			bool indexed = !shared_data_ptr->index_tokens.empty() && log.isValid() && findFromTokenIndex(log, *shared_data_ptr, lines_found);
+			if (!indexed && log.isValid()) {
+				auto [first, last] = log.getLineRange(shared_data_ptr->period);
+				bool sorted = log.isSorted();
+				for (std::size_t i = first; i < last; ++i) {
+					if (shared_data_ptr->user_filter && !shared_data_ptr->user_filter(log.getName(i))) continue;
+					if (sorted || shared_data_ptr->period.isInside(log.getTime(i))) {
+						if (shared_data_ptr->find_func(log.getMessage(i))) {
+							lines_found.push_back(i);
 						}
 					}
 				}
@@ -438,39 +734,85 @@ private:
 		catch (std::exception) {
 		}
 
-		std::lock_guard<std::mutex> lock(shared_data_ptr->mutex);
-		if (shared_data_ptr->reference_count > 0) {
-			--shared_data_ptr->reference_count;
-			if (!lines_found.empty()) {
-				shared_data_ptr->shared_lines_found.insert(shared_data_ptr->shared_lines_found.end(), lines_found.begin(), lines_found.end());
+		if (!lines_found.empty()) {
+			//logs are written in time order, only sort a run if the log was not
+			if (!log.isSorted()) {
+				std::stable_sort(
+					lines_found.begin(),
+					lines_found.end(),
+					[&log](std::size_t a, std::size_t b) {return log.getTime(a) < log.getTime(b); }
+				);
 			}
-			if (shared_data_ptr->reference_count == 0) {
-				if (!shared_data_ptr->shared_lines_found.empty()) {
-					std::string str = shared_data_ptr->dump_func(shared_data_ptr->shared_lines_found);
-					auto upload_handler = [irc_msg = std::move(shared_data_ptr->irc_msg), this](std::string && str) {
-						nuulsServerReply(str, irc_msg);
-					};
-					std::make_shared<DankHttp::NuulsUploader>(m_ioc)->run(
-						upload_handler,
-						std::move(str),
-						"i.nuuls.com",
-						"443",
-						"/upload?key=dank_password"
-					);
-				}
-				else {
-					std::stringstream reply;
-					reply << shared_data_ptr->irc_msg.getNick() << ", no hit NaM";
-					replyToIRCMessage(shared_data_ptr->irc_msg, reply.str());
-				}
+			shared_data_ptr->pushRun(std::make_shared<const Log>(std::move(log)), std::move(lines_found));
+		}
+	}
+
+	/*
+	Find lines with any of index_tokens with token index of log, only matching
+	lines are read.
+	Return:
+		false if log has no token index
+	*/
+	bool findFromTokenIndex(const Log & log, const FindCallbackSharedData & shared_data, std::vector<std::size_t> & lines_found)
+	{
+		const TokenIndex * index = log.getTokenIndex();
+		if (!index) return false;
+		auto [first, last] = log.getLineRange(shared_data.period);
+		bool sorted = log.isSorted();
+		std::size_t base = log.getArchiveFirst();
+		for (auto & token : shared_data.index_tokens) {
+			if (auto postings = index->find(token)) {
+				postings->forEach(base + first, base + last, [&](std::uint64_t line_id) {
+					lines_found.push_back(static_cast<std::size_t>(line_id - base));
+				});
 			}
 		}
+		//union of posting lists in line order
+		std::sort(lines_found.begin(), lines_found.end());
+		lines_found.erase(std::unique(lines_found.begin(), lines_found.end()), lines_found.end());
+		auto rejected = [&](std::size_t i) {
+			if (shared_data.user_filter && !shared_data.user_filter(log.getName(i))) return true;
+			return !sorted && !shared_data.period.isInside(log.getTime(i));
+		};
+		lines_found.erase(std::remove_if(lines_found.begin(), lines_found.end(), rejected), lines_found.end());
+		return true;
+	}
+
+	void findCommandTargetDoneHandler(std::shared_ptr<FindCallbackSharedData> shared_data_ptr)
+	{
+		if (shared_data_ptr->reference_count.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+		if (shared_data_ptr->replied.exchange(true)) return;
+		auto lines_found = std::make_shared<const FindCallbackSharedData::SharedLinesFound>(shared_data_ptr->mergeRuns());
+		if (!lines_found->empty()) {
+			//lines are formatted while uploading, shared data keeps referenced logs alive
+			auto generator_factory = [shared_data_ptr, lines_found]() -> DankHttp::NuulsUploader::GeneratorType {
+				return [shared_data_ptr, lines_found, pos = std::size_t(0)](std::string & buffer) mutable {
+					if (pos >= lines_found->size()) return false;
+					shared_data_ptr->dump_func((*lines_found)[pos++], buffer);
+					return true;
+				};
+			};
+			auto upload_handler = [irc_msg = shared_data_ptr->irc_msg, this](std::string && str) {
+				nuulsServerReply(str, irc_msg);
+			};
+			std::make_shared<DankHttp::NuulsUploader>(m_connection_pool)->run(
+				upload_handler,
+				std::move(generator_factory),
+				"i.nuuls.com",
+				"443",
+				"/upload?key=dank_password"
+			);
+		}
+		else {
+			std::stringstream reply;
+			reply << shared_data_ptr->irc_msg.getNick() << ", no hit NaM";
+			replyToIRCMessage(shared_data_ptr->irc_msg, reply.str());
+		}
 	}
 
 	void findCommandErrorHandler(std::shared_ptr<FindCallbackSharedData> shared_data_ptr)
 	{
-		std::lock_guard<std::mutex> lock(shared_data_ptr->mutex);
-		shared_data_ptr->reference_count = 0;
+		if (shared_data_ptr->replied.exchange(true)) return;
 		std::stringstream reply;
 		reply
 			<< shared_data_ptr->irc_msg.getNick()
@@ -491,9 +833,28 @@ private:
 	
 	void nuulsServerReply(const std::string & str, const IRCMessage & msg);
 
+	/*
+	Months overlapping period, period is half open so a period ending at the
+	start of a month does not include that month.
+	*/
 	std::vector<date::year_month> periodToYearMonths(const TimeDetail::TimePeriod & period);
 	
+	/*
+	Days overlapping period, half open like periodToYearMonths.
+	*/
 	std::vector<date::year_month_day> periodToDates(const TimeDetail::TimePeriod & period);
+
+	/*
+	Estimated download size of one log, including request overhead.
+	*/
+	static constexpr std::uintmax_t m_estimated_user_month_log_bytes = 48 * 1024;
+	static constexpr std::uintmax_t m_estimated_channel_day_log_bytes = 4 * 1024 * 1024;
+
+	/*
+	Check if channel day logs are expected to be cheaper than user month logs
+	(per channel).
+	*/
+	static bool preferChannelLogs(std::size_t users, std::size_t months, std::size_t days);
 };
 
 /*
@@ -543,25 +904,19 @@ bool isInPrefixCaseless(const C1 & str, const C2 & sub)
 }
 
 /*
-Count show many times search occurs in str.
+Caseless compare.
 */
-template <typename Iterator, typename Searcher>
-std::size_t countTargetOccurrences(Iterator begin, Iterator end, const Searcher & searcher)
-{
-	std::size_t count = 0;
-	auto it = begin;
-	while ((it = std::search(it, end, searcher)) != end) {
-		++count;
-		std::advance(it, 1);
-	}
-	return count;
-}
-std::size_t countTargetOccurrences(std::string_view str, const std::regex & regex);
+bool caselessCompare(std::string_view str1, std::string_view str2);
 
 /*
-Caseless compare.
+Predicate accepting names equal to one of users (caseless).
 */
-bool caselessCompare(std::string_view str1, std::string_view str2);
+std::function<bool(std::string_view)> createUserFilter(const std::vector<std::string_view> & users);
+
+/*
+Lowercase targets for TokenIndex lookups.
+*/
+std::vector<std::string> createIndexTokens(const std::vector<std::string> & targets);
 
 //to lower case string.
 inline std::string toLowerCaseString(std::string_view source)
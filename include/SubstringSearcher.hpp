@@ -0,0 +1,67 @@
+//SubstringSearcher.hpp
+#pragma once
+#ifndef SubstringSearcher_HEADER
+#define SubstringSearcher_HEADER
+
+//C++
+#include <string>
+#include <string_view>
+#include <cstddef>
+
+/*
+Substring search for one needle over many haystacks.
+Candidates are found by comparing first and last byte of needle against 16 or
+32 haystack bytes at a time (SSE2 or AVX2, picked once at runtime from cpu
+features), only candidates are compared in full. A scalar kernel is used on
+other architectures.
+Caseless search folds ASCII letters, other bytes must match exactly.
+*/
+class SubstringSearcher
+{
+public:
+	static constexpr std::size_t npos = std::string_view::npos;
+
+	SubstringSearcher(std::string_view needle, bool caseless);
+
+	/*
+	Find first occurrence at or after pos.
+	Return:
+		index of occurrence
+		npos if not found
+	*/
+	std::size_t find(std::string_view haystack, std::size_t pos = 0) const;
+
+	bool contains(std::string_view haystack) const;
+
+	/*
+	Count occurrences, overlapping occurrences are counted.
+	Empty needle counts as 0.
+	*/
+	std::size_t count(std::string_view haystack) const;
+
+	/*
+	Name of kernel selected for this cpu.
+	*/
+	static const char * getKernelName();
+
+	/*
+	Kernel(haystack, pos, needle, caseless), needle is not empty and is
+	lower case if caseless.
+	*/
+	using KernelFunc = std::size_t(*)(std::string_view, std::size_t, std::string_view, bool);
+
+private:
+	struct Kernel
+	{
+		KernelFunc func;
+		const char * name;
+	};
+
+	static const Kernel & getKernel();
+
+	std::string m_needle;
+	bool m_caseless;
+	KernelFunc m_kernel;
+};
+
+#endif // !SubstringSearcher_HEADER
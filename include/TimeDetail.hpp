@@ -13,6 +13,9 @@
 #include <unordered_map>
 #include <mutex>
 #include <chrono>
+#include <sstream>
+#include <cstring>
+#include <cstdint>
 
 //Date
 #include <date/date.h>
@@ -28,8 +31,76 @@ namespace TimeDetail
 		return ss.str();
 	}
 
+	namespace detail
+	{
+		/*
+		Days since 1970-01-01 of proleptic Gregorian date.
+		*/
+		constexpr std::int64_t daysFromCivil(std::int64_t y, unsigned m, unsigned d)
+		{
+			y -= m <= 2;
+			const std::int64_t era = (y >= 0 ? y : y - 399) / 400;
+			const unsigned yoe = static_cast<unsigned>(y - era * 400);
+			const unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+			const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+			return era * 146097 + static_cast<std::int64_t>(doe) - 719468;
+		}
+
+		/*
+		Parse exactly "YYYY-MM-DD HH:MM:SS".
+		Days of the last date seen by this thread are cached, log lines come
+		in time order so usually only the time part is converted.
+		Return:
+			time point if view has that exact shape and is a valid time
+			std::nullopt if not, caller should fall back to date::parse
+		*/
+		inline std::optional<TimePoint> parseFixedDateTime(std::string_view view)
+		{
+			constexpr std::size_t size = 19;
+			if (view.size() != size) return std::nullopt;
+			const char * p = view.data();
+
+			//every position is checked without branching, then rejected once
+			auto digit = [p](std::size_t i) { return static_cast<unsigned>(static_cast<unsigned char>(p[i]) - '0'); };
+			unsigned bad =
+				(p[4] != '-') | (p[7] != '-') | (p[10] != ' ') | (p[13] != ':') | (p[16] != ':');
+			for (std::size_t i : { 0, 1, 2, 3, 5, 6, 8, 9, 11, 12, 14, 15, 17, 18 }) {
+				bad |= digit(i) > 9;
+			}
+			if (bad) return std::nullopt;
+
+			const unsigned hour = digit(11) * 10 + digit(12);
+			const unsigned minute = digit(14) * 10 + digit(15);
+			const unsigned second = digit(17) * 10 + digit(18);
+			if ((hour > 23) | (minute > 59) | (second > 59)) return std::nullopt;
+
+			struct DateCache
+			{
+				char date[10] = {};
+				std::int64_t days = 0;
+			};
+			thread_local DateCache cache;
+			if (std::memcmp(cache.date, p, sizeof(cache.date)) != 0) {
+				const int year = static_cast<int>(digit(0) * 1000 + digit(1) * 100 + digit(2) * 10 + digit(3));
+				const unsigned month = digit(5) * 10 + digit(6);
+				const unsigned day = digit(8) * 10 + digit(9);
+				if (!date::year_month_day(date::year(year), date::month(month), date::day(day)).ok()) {
+					return std::nullopt;
+				}
+				cache.days = daysFromCivil(year, month, day);
+				std::memcpy(cache.date, p, sizeof(cache.date));
+			}
+
+			const std::int64_t seconds = cache.days * 86400 + hour * 3600 + minute * 60 + second;
+			return TimePoint(std::chrono::seconds(seconds));
+		}
+	}
+
 	inline std::optional<TimePoint> parseGempirTimeString(const std::string_view & view)
 	{
+		if (auto r = detail::parseFixedDateTime(view)) {
+			return r;
+		}
 		std::stringstream ss;
 		ss << view;
 		TimePoint point;
@@ -44,6 +115,12 @@ namespace TimeDetail
 
 	inline std::optional<TimePoint> parseOverrustleTimeString(const std::string_view & view)
 	{
+		constexpr std::string_view utc_suffix(" UTC");
+		if (view.size() > utc_suffix.size() && view.substr(view.size() - utc_suffix.size()) == utc_suffix) {
+			if (auto r = detail::parseFixedDateTime(view.substr(0, view.size() - utc_suffix.size()))) {
+				return r;
+			}
+		}
 		std::stringstream ss;
 		ss << view;
 		TimePoint point;
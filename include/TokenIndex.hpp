@@ -0,0 +1,194 @@
+//TokenIndex.hpp
+#pragma once
+#ifndef TokenIndex_HEADER
+#define TokenIndex_HEADER
+
+//C++
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <optional>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+//local
+#include "Log.hpp"
+
+/*
+Read-only inverted index of the tokens in a log, stored after a LogArchive.
+A token is a run of non whitespace bytes, lowercased (ASCII). Every
+occurrence of a token adds its line id to the token's posting list, so a
+line id is repeated if the token is repeated in the line. Line ids are
+ascending, stored as varint deltas.
+
+Layout (native byte order, every section 8 byte aligned):
+	Header
+	std::uint64_t	token_offsets[token_count + 1]
+	std::uint64_t	posting_offsets[token_count + 1]
+	std::uint64_t	posting_counts[token_count]
+	char			token_blob[token_blob_size]			tokens in sorted order
+	std::uint8_t	posting_blob[posting_blob_size]
+*/
+class TokenIndex
+{
+public:
+	struct Header
+	{
+		char magic[8];
+		std::uint64_t line_count;
+		std::uint64_t token_count;
+		std::uint64_t token_blob_size;
+		std::uint64_t posting_blob_size;
+	};
+
+	class Builder;
+
+	/*
+	Posting list of one token.
+	*/
+	class Postings
+	{
+	public:
+		Postings(const std::uint8_t * begin, const std::uint8_t * end, std::uint64_t count) :
+			m_begin(begin),
+			m_end(end),
+			m_count(count)
+		{
+		}
+
+		/*
+		Number of occurrences.
+		*/
+		std::uint64_t size() const
+		{
+			return m_count;
+		}
+
+		/*
+		Call func(line_id) for every occurrence with line_id in [first, last).
+		*/
+		template <class F>
+		void forEach(std::uint64_t first, std::uint64_t last, F && func) const
+		{
+			std::uint64_t line_id = 0;
+			const std::uint8_t * p = m_begin;
+			while (p < m_end) {
+				std::uint64_t delta = 0;
+				int shift = 0;
+				while (p < m_end) {
+					std::uint8_t b = *p++;
+					delta |= static_cast<std::uint64_t>(b & 0x7f) << shift;
+					if ((b & 0x80) == 0) break;
+					shift += 7;
+				}
+				line_id += delta;
+				if (line_id >= last) return;
+				if (line_id >= first) func(line_id);
+			}
+		}
+
+	private:
+		const std::uint8_t * m_begin;
+		const std::uint8_t * m_end;
+		std::uint64_t m_count;
+	};
+
+	/*
+	Index stored in [data, data + size), data must be 8 byte aligned and
+	outlive the index.
+	Return:
+		index if data holds a valid index
+		std::nullopt if not
+	*/
+	static std::optional<TokenIndex> view(const char * data, std::uint64_t size);
+
+	/*
+	Lines indexed.
+	*/
+	std::uint64_t getNumberOfLines() const;
+
+	/*
+	Postings of token, token must be lowercase.
+	Return:
+		postings if token occurs
+		std::nullopt if not
+	*/
+	std::optional<Postings> find(std::string_view token) const;
+
+	/*
+	Call func(token) for every token of str.
+	*/
+	template <class F>
+	static void forEachToken(std::string_view str, F && func)
+	{
+		std::size_t pos = 0;
+		while (pos < str.size()) {
+			while (pos < str.size() && isSpace(str[pos])) ++pos;
+			std::size_t begin = pos;
+			while (pos < str.size() && !isSpace(str[pos])) ++pos;
+			if (pos > begin) func(str.substr(begin, pos - begin));
+		}
+	}
+
+	/*
+	Lowercase token (ASCII) into out.
+	*/
+	static void lowerToken(std::string_view token, std::string & out);
+
+	/*
+	Check if str is one token.
+	*/
+	static bool isToken(std::string_view str);
+
+private:
+	static bool isSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+	}
+
+	TokenIndex() = default;
+
+	std::string_view getToken(std::uint64_t i) const;
+
+	const Header * m_header = nullptr;
+	const std::uint64_t * m_token_offsets = nullptr;
+	const std::uint64_t * m_posting_offsets = nullptr;
+	const std::uint64_t * m_posting_counts = nullptr;
+	const char * m_token_blob = nullptr;
+	const std::uint8_t * m_posting_blob = nullptr;
+};
+
+/*
+Build index from logs appended one after another, line ids continue across
+appends like the lines of LogArchive::Builder.
+*/
+class TokenIndex::Builder
+{
+public:
+	void append(const Log & log);
+
+	/*
+	Write index at current position of stream.
+	Position must be 8 byte aligned relative to the start of the file.
+	Return:
+		true if written
+	*/
+	bool write(std::ostream & stream) const;
+
+private:
+	struct PostingList
+	{
+		std::string bytes;
+		std::uint64_t last = 0;
+		std::uint64_t count = 0;
+	};
+
+	std::unordered_map<std::string, PostingList> m_postings;
+	std::uint64_t m_line_count = 0;
+	std::string m_token; //reused for lookups
+};
+
+#endif // !TokenIndex_HEADER
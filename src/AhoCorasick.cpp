@@ -0,0 +1,91 @@
+//AhoCorasick.cpp
+
+#include "../include/AhoCorasick.hpp"
+
+AhoCorasick::AhoCorasick(const std::vector<std::string_view> & patterns, bool caseless) :
+	m_number_of_patterns(patterns.size())
+{
+	for (std::size_t b = 0; b < alphabet_size; ++b) {
+		m_fold[b] = static_cast<unsigned char>((caseless && b >= 'A' && b <= 'Z') ? b + ('a' - 'A') : b);
+	}
+
+	//trie, 0 in m_next means no edge (root is never a child)
+	constexpr State none = 0;
+	m_next.assign(alphabet_size, none);
+	std::vector<std::vector<std::uint32_t>> outputs(1);
+	for (std::size_t i = 0; i < patterns.size(); ++i) {
+		if (patterns[i].empty()) continue;
+		State s = 0;
+		for (char c : patterns[i]) {
+			State & edge = m_next[s * alphabet_size + foldByte(c)];
+			if (edge == none) {
+				edge = static_cast<State>(outputs.size());
+				outputs.emplace_back();
+				m_next.resize(m_next.size() + alphabet_size, none);
+			}
+			s = m_next[s * alphabet_size + foldByte(c)];
+		}
+		outputs[s].push_back(static_cast<std::uint32_t>(i));
+	}
+
+	//breadth first, fill missing edges from failure state and inherit its outputs
+	std::vector<State> fail(outputs.size(), 0);
+	std::queue<State> queue;
+	for (std::size_t b = 0; b < alphabet_size; ++b) {
+		State child = m_next[b];
+		if (child != none) {
+			fail[child] = 0;
+			queue.push(child);
+		}
+	}
+	while (!queue.empty()) {
+		State s = queue.front();
+		queue.pop();
+		const auto & inherited = outputs[fail[s]];
+		outputs[s].insert(outputs[s].end(), inherited.begin(), inherited.end());
+		for (std::size_t b = 0; b < alphabet_size; ++b) {
+			State & edge = m_next[s * alphabet_size + b];
+			State fallback = m_next[fail[s] * alphabet_size + b];
+			if (edge == none) {
+				edge = fallback;
+			}
+			else {
+				fail[edge] = fallback;
+				queue.push(edge);
+			}
+		}
+	}
+
+	m_output_offsets.reserve(outputs.size() + 1);
+	m_output_offsets.push_back(0);
+	for (auto & out : outputs) {
+		m_outputs.insert(m_outputs.end(), out.begin(), out.end());
+		m_output_offsets.push_back(static_cast<std::uint32_t>(m_outputs.size()));
+	}
+}
+
+std::size_t AhoCorasick::getNumberOfPatterns() const
+{
+	return m_number_of_patterns;
+}
+
+void AhoCorasick::count(std::string_view text, std::vector<std::size_t> & counts) const
+{
+	State s = 0;
+	for (char c : text) {
+		s = m_next[s * alphabet_size + foldByte(c)];
+		for (std::uint32_t i = m_output_offsets[s]; i < m_output_offsets[s + 1]; ++i) {
+			++counts[m_outputs[i]];
+		}
+	}
+}
+
+bool AhoCorasick::containsAny(std::string_view text) const
+{
+	State s = 0;
+	for (char c : text) {
+		s = m_next[s * alphabet_size + foldByte(c)];
+		if (m_output_offsets[s] != m_output_offsets[s + 1]) return true;
+	}
+	return false;
+}
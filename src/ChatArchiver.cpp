@@ -0,0 +1,266 @@
+//ChatArchiver.cpp
+
+#include "../include/ChatArchiver.hpp"
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace
+{
+	void appendDigits(std::string & out, unsigned value, std::size_t width)
+	{
+		char digits[8];
+		for (std::size_t i = width; i > 0; --i) {
+			digits[i - 1] = static_cast<char>('0' + value % 10);
+			value /= 10;
+		}
+		out.append(digits, width);
+	}
+
+	void appendDate(std::string & out, const date::year_month_day & date)
+	{
+		appendDigits(out, static_cast<unsigned>(static_cast<int>(date.year())), 4);
+		out.push_back('-');
+		appendDigits(out, static_cast<unsigned>(date.month()), 2);
+		out.push_back('-');
+		appendDigits(out, static_cast<unsigned>(date.day()), 2);
+	}
+
+	/*
+	Flush stdio buffer and wait until file is on disk.
+	*/
+	bool syncFile(std::FILE * file)
+	{
+		if (std::fflush(file) != 0) return false;
+#ifdef _WIN32
+		return _commit(_fileno(file)) == 0;
+#else
+		return fsync(fileno(file)) == 0;
+#endif
+	}
+}
+
+ChatArchiver::ChatArchiver(const std::filesystem::path & directory, Duration retention, Duration commit_interval, std::size_t commit_bytes) :
+	m_directory(directory),
+	m_retention(retention),
+	m_commit_interval(commit_interval),
+	m_commit_bytes(commit_bytes)
+{
+	std::error_code ec;
+	std::filesystem::create_directories(m_directory, ec);
+	if (ec) throw std::runtime_error("Can't create chat archive directory");
+	m_thread = std::thread(&ChatArchiver::writerFunc, this);
+}
+
+ChatArchiver::~ChatArchiver()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_cv.notify_one();
+	m_thread.join();
+	for (auto & pair : m_files) {
+		std::fclose(pair.second.file);
+	}
+}
+
+void ChatArchiver::Lines::add(std::string_view channel, TimeDetail::TimePoint time, std::string_view user, std::string_view message)
+{
+	auto day = std::chrono::floor<date::days>(time);
+	date::year_month_day date(day);
+	date::hh_mm_ss<std::chrono::seconds> clock(std::chrono::floor<std::chrono::seconds>(time - day));
+	std::string & lines = m_segments[createSegmentName(channel, date)];
+	if (!channel.empty() && channel.front() == '#') {
+		channel.remove_prefix(1);
+	}
+
+	std::size_t size = lines.size();
+	lines.push_back('[');
+	appendDate(lines, date);
+	lines.push_back(' ');
+	appendDigits(lines, static_cast<unsigned>(clock.hours().count()), 2);
+	lines.push_back(':');
+	appendDigits(lines, static_cast<unsigned>(clock.minutes().count()), 2);
+	lines.push_back(':');
+	appendDigits(lines, static_cast<unsigned>(clock.seconds().count()), 2);
+	lines.append("] #").append(channel).append(" ").append(user).append(": ").append(message).append("\n");
+	m_bytes += lines.size() - size;
+}
+
+bool ChatArchiver::Lines::empty() const
+{
+	return m_segments.empty();
+}
+
+void ChatArchiver::append(Lines && lines)
+{
+	if (lines.empty()) return;
+	bool notify;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_pending.empty()) {
+			std::swap(m_pending, lines);
+		}
+		else {
+			for (auto & pair : lines.m_segments) {
+				auto result = m_pending.m_segments.try_emplace(pair.first);
+				if (result.second) {
+					result.first->second = std::move(pair.second);
+				}
+				else {
+					result.first->second.append(pair.second);
+				}
+			}
+			m_pending.m_bytes += lines.m_bytes;
+		}
+		notify = m_pending.m_bytes >= m_commit_bytes;
+	}
+	if (notify) {
+		m_cv.notify_one();
+	}
+}
+
+std::string ChatArchiver::read(std::string_view segment)
+{
+	std::string data;
+	std::ifstream fs(m_directory / std::filesystem::path(segment), std::ios::in | std::ios::binary);
+	if (!fs.is_open()) return data;
+	data.assign(std::istreambuf_iterator<char>(fs), std::istreambuf_iterator<char>());
+	//drop line the writer is in the middle of
+	std::size_t end = data.rfind('\n');
+	data.resize(end == data.npos ? 0 : end + 1);
+	return data;
+}
+
+std::string ChatArchiver::createSegmentName(std::string_view channel, const date::year_month_day & date)
+{
+	std::string name;
+	for (char c : channel) {
+		if (c >= 'A' && c <= 'Z') {
+			name.push_back(static_cast<char>(c + ('a' - 'A')));
+		}
+		else if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_') {
+			name.push_back(c);
+		}
+	}
+	if (name.empty()) {
+		name.push_back('_');
+	}
+	name.push_back('/');
+	appendDate(name, date);
+	name.append(".log");
+	return name;
+}
+
+void ChatArchiver::writerFunc()
+{
+	Batch batch;
+	bool stop = false;
+	while (!stop) {
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			//wait a full interval so lines from many messages share one sync
+			m_cv.wait_for(lock, m_commit_interval, [this]() {return m_stop || m_pending.m_bytes >= m_commit_bytes; });
+			std::swap(batch, m_pending);
+			stop = m_stop;
+		}
+		writeBatch(batch);
+		batch = Batch();
+	}
+}
+
+void ChatArchiver::writeBatch(Batch & batch)
+{
+	auto now = std::chrono::system_clock::now();
+	std::vector<std::FILE*> written;
+	for (auto & pair : batch.m_segments) {
+		std::FILE * file = openSegment(pair.first);
+		if (!file) continue;
+		if (std::fwrite(pair.second.data(), 1, pair.second.size(), file) != pair.second.size()) {
+			std::cout << "ChatArchiver: can't write " << pair.first << "\n";
+		}
+		m_files[pair.first].last_write = now;
+		written.push_back(file);
+	}
+	for (std::FILE * file : written) {
+		if (!syncFile(file)) {
+			std::cout << "ChatArchiver: can't sync segment\n";
+		}
+	}
+	closeIdle(now);
+	if (now >= m_next_cleanup) {
+		removeExpired(now);
+		m_next_cleanup = now + m_cleanup_interval;
+	}
+}
+
+std::FILE * ChatArchiver::openSegment(const std::string & segment)
+{
+	auto it = m_files.find(segment);
+	if (it != m_files.end()) {
+		return it->second.file;
+	}
+	std::filesystem::path path = m_directory / std::filesystem::path(segment);
+	std::error_code ec;
+	std::filesystem::create_directories(path.parent_path(), ec);
+	std::FILE * file = std::fopen(path.string().c_str(), "ab");
+	if (!file) {
+		std::cout << "ChatArchiver: can't open " << segment << "\n";
+		return nullptr;
+	}
+	m_files.emplace(segment, OpenFile{ file, TimeDetail::TimePoint() });
+	return file;
+}
+
+void ChatArchiver::closeIdle(TimeDetail::TimePoint now)
+{
+	for (auto it = m_files.begin(); it != m_files.end();) {
+		if (now - it->second.last_write >= m_idle_close) {
+			std::fclose(it->second.file);
+			it = m_files.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+}
+
+void ChatArchiver::removeExpired(TimeDetail::TimePoint now)
+{
+	//segment names sort by day
+	std::string oldest;
+	appendDate(oldest, date::year_month_day(std::chrono::floor<date::days>(now - m_retention)));
+	oldest.append(".log");
+
+	std::error_code ec;
+	for (auto & channel : std::filesystem::directory_iterator(m_directory, ec)) {
+		if (!channel.is_directory(ec)) continue;
+		std::vector<std::filesystem::path> expired;
+		bool empty = true;
+		for (auto & segment : std::filesystem::directory_iterator(channel.path(), ec)) {
+			std::string name = segment.path().filename().string();
+			if (name.size() == oldest.size() && name < oldest) {
+				expired.push_back(segment.path());
+			}
+			else {
+				empty = false;
+			}
+		}
+		for (auto & path : expired) {
+			std::string segment = channel.path().filename().string().append("/").append(path.filename().string());
+			auto it = m_files.find(segment);
+			if (it != m_files.end()) {
+				std::fclose(it->second.file);
+				m_files.erase(it);
+			}
+			std::filesystem::remove(path, ec);
+		}
+		if (empty) {
+			std::filesystem::remove(channel.path(), ec);
+		}
+	}
+}
@@ -0,0 +1,112 @@
+//ComputePool.cpp
+
+#include "../include/ComputePool.hpp"
+
+namespace
+{
+	//pool and worker index of current thread
+	thread_local const ComputePool * current_pool = nullptr;
+	thread_local std::size_t current_worker = 0;
+}
+
+ComputePool::ComputePool(std::size_t threads)
+{
+	if (threads == 0) {
+		threads = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+	}
+	for (std::size_t i = 0; i < threads; ++i) {
+		m_workers.push_back(std::make_unique<Worker>());
+	}
+	for (std::size_t i = 0; i < threads; ++i) {
+		m_threads.emplace_back(&ComputePool::workerFunc, this, i);
+	}
+}
+
+ComputePool::~ComputePool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_sleep_mutex);
+		m_stop = true;
+	}
+	m_sleep_cv.notify_all();
+	//a task must never own the pool, joining its own worker would deadlock
+	assert(current_pool != this);
+	for (auto & thread : m_threads) {
+		thread.join();
+	}
+}
+
+void ComputePool::post(TaskType task)
+{
+	std::size_t index;
+	if (current_pool == this) {
+		index = current_worker;
+	}
+	else {
+		index = m_next_worker.fetch_add(1, std::memory_order_relaxed) % m_workers.size();
+	}
+	{
+		//counted first so it never drops below the number of queued tasks,
+		//under sleep mutex so a worker about to sleep can not miss it
+		std::lock_guard<std::mutex> lock(m_sleep_mutex);
+		++m_pending;
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_workers[index]->mutex);
+		m_workers[index]->tasks.push_back(std::move(task));
+	}
+	m_sleep_cv.notify_one();
+}
+
+std::size_t ComputePool::getNumberOfThreads() const
+{
+	return m_threads.size();
+}
+
+void ComputePool::workerFunc(std::size_t index)
+{
+	current_pool = this;
+	current_worker = index;
+	TaskType task;
+	while (true) {
+		if (popTask(index, task)) {
+			--m_pending;
+			try {
+				task();
+			}
+			catch (std::exception & e) {
+				std::cerr << "ComputePool task: " << e.what() << "\n";
+			}
+			task = nullptr;
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(m_sleep_mutex);
+		m_sleep_cv.wait(lock, [this] {return m_stop || m_pending > 0; });
+		if (m_stop && m_pending == 0) {
+			return;
+		}
+	}
+}
+
+bool ComputePool::popTask(std::size_t index, TaskType & task)
+{
+	{
+		auto & own = *m_workers[index];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.tasks.empty()) {
+			task = std::move(own.tasks.back());
+			own.tasks.pop_back();
+			return true;
+		}
+	}
+	for (std::size_t i = 1; i < m_workers.size(); ++i) {
+		auto & victim = *m_workers[(index + i) % m_workers.size()];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.tasks.empty()) {
+			task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
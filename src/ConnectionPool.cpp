@@ -0,0 +1,243 @@
+//ConnectionPool.cpp
+
+#include "../include/ConnectionPool.hpp"
+
+ConnectionPool::ConnectionPool(boost::asio::io_context & ioc, Clock::duration idle_timeout) :
+	m_ioc(ioc),
+	m_ctx{ boost::asio::ssl::context::sslv23_client },
+	m_idle_timeout(idle_timeout),
+	m_reap_timer(ioc)
+{
+	load_root_certificates(m_ctx);
+	//sessions are kept by the pool, the client cache must be on for OpenSSL to hand them out
+	SSL_CTX_set_session_cache_mode(m_ctx.native_handle(), SSL_SESS_CACHE_CLIENT);
+}
+
+ConnectionPool::~ConnectionPool()
+{
+	for (auto & p : m_hosts) {
+		if (p.second.session) {
+			SSL_SESSION_free(p.second.session);
+		}
+	}
+}
+
+boost::asio::io_context & ConnectionPool::getIoContext()
+{
+	return m_ioc;
+}
+
+void ConnectionPool::acquire(const std::string & host, const std::string & port, HandlerType handler)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto & entry = m_hosts[createKey(host, port)];
+		auto now = Clock::now();
+		while (!entry.idle.empty()) {
+			Idle idle = std::move(entry.idle.back());
+			entry.idle.pop_back();
+			if (now - idle.since < m_idle_timeout) {
+				auto stream = std::make_shared<StreamPtr>(std::move(idle.stream));
+				boost::asio::post(
+					m_ioc,
+					[handler, stream]() {
+						handler(boost::system::error_code(), std::move(*stream), true);
+					}
+				);
+				return;
+			}
+		}
+	}
+	std::make_shared<Connector>(shared_from_this(), host, port, std::move(handler))->run();
+}
+
+void ConnectionPool::release(const std::string & host, const std::string & port, StreamPtr stream)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto & entry = m_hosts[createKey(host, port)];
+	saveSession(entry, *stream);
+	if (entry.idle.size() >= max_idle_per_host) {
+		entry.idle.erase(entry.idle.begin());
+	}
+	entry.idle.push_back(Idle{ std::move(stream), Clock::now() });
+	startReapTimer();
+}
+
+std::string ConnectionPool::createKey(const std::string & host, const std::string & port)
+{
+	std::string key;
+	key.append(host).append(":").append(port);
+	return key;
+}
+
+void ConnectionPool::saveSession(HostEntry & entry, Stream & stream)
+{
+	SSL_SESSION * session = SSL_get1_session(stream.native_handle());
+	if (!session) return;
+	if (entry.session) {
+		SSL_SESSION_free(entry.session);
+	}
+	entry.session = session;
+}
+
+void ConnectionPool::startReapTimer()
+{
+	if (m_reap_timer_running) return;
+	m_reap_timer_running = true;
+	m_reap_timer.expires_after(m_idle_timeout);
+	m_reap_timer.async_wait(
+		std::bind(
+			&ConnectionPool::reapHandler,
+			shared_from_this(),
+			std::placeholders::_1
+		)
+	);
+}
+
+void ConnectionPool::reapHandler(boost::system::error_code ec)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_reap_timer_running = false;
+	if (ec == boost::asio::error::operation_aborted) return;
+	auto now = Clock::now();
+	bool any_idle = false;
+	for (auto & p : m_hosts) {
+		auto & idle = p.second.idle;
+		idle.erase(
+			std::remove_if(
+				idle.begin(),
+				idle.end(),
+				[&](const Idle & e) {return now - e.since >= m_idle_timeout; }
+			),
+			idle.end()
+		);
+		any_idle = any_idle || !idle.empty();
+	}
+	if (any_idle) {
+		startReapTimer();
+	}
+}
+
+ConnectionPool::Connector::Connector(std::shared_ptr<ConnectionPool> pool, const std::string & host, const std::string & port, HandlerType handler) :
+	m_pool(std::move(pool)),
+	m_host(host),
+	m_port(port),
+	m_handler(std::move(handler)),
+	m_resolver(m_pool->m_ioc)
+{
+}
+
+void ConnectionPool::Connector::run()
+{
+	boost::asio::ip::tcp::resolver::results_type results;
+	{
+		std::lock_guard<std::mutex> lock(m_pool->m_mutex);
+		auto & entry = m_pool->m_hosts[createKey(m_host, m_port)];
+		if (!entry.results.empty() && Clock::now() - entry.resolved < resolve_ttl) {
+			results = entry.results;
+		}
+	}
+	if (!results.empty()) {
+		connect(results);
+		return;
+	}
+	m_resolver.async_resolve(
+		m_host,
+		m_port,
+		std::bind(
+			&Connector::resolveHandler,
+			shared_from_this(),
+			std::placeholders::_1,
+			std::placeholders::_2
+		)
+	);
+}
+
+void ConnectionPool::Connector::resolveHandler(boost::system::error_code ec, boost::asio::ip::tcp::resolver::results_type results)
+{
+	if (ec) {
+		fail(ec);
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_pool->m_mutex);
+		auto & entry = m_pool->m_hosts[createKey(m_host, m_port)];
+		entry.results = results;
+		entry.resolved = Clock::now();
+	}
+	connect(results);
+}
+
+void ConnectionPool::Connector::connect(const boost::asio::ip::tcp::resolver::results_type & results)
+{
+	m_stream = std::make_unique<Stream>(m_pool->m_ioc, m_pool->m_ctx);
+	if (!SSL_set_tlsext_host_name(m_stream->native_handle(), m_host.c_str())) {
+		fail(boost::system::error_code{ static_cast<int>(::ERR_get_error()), boost::asio::error::get_ssl_category() });
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_pool->m_mutex);
+		auto & entry = m_pool->m_hosts[createKey(m_host, m_port)];
+		if (entry.session) {
+			SSL_set_session(m_stream->native_handle(), entry.session);
+		}
+	}
+	boost::asio::async_connect(
+		m_stream->next_layer(),
+		results.begin(),
+		results.end(),
+		std::bind(
+			&Connector::connectHandler,
+			shared_from_this(),
+			std::placeholders::_1
+		)
+	);
+}
+
+void ConnectionPool::Connector::connectHandler(boost::system::error_code ec)
+{
+	if (ec) {
+		{
+			//endpoints may be stale, resolve again next time
+			std::lock_guard<std::mutex> lock(m_pool->m_mutex);
+			m_pool->m_hosts[createKey(m_host, m_port)].results = {};
+		}
+		fail(ec);
+		return;
+	}
+	m_stream->async_handshake(
+		boost::asio::ssl::stream_base::client,
+		std::bind(
+			&Connector::handshakeHandler,
+			shared_from_this(),
+			std::placeholders::_1
+		)
+	);
+}
+
+void ConnectionPool::Connector::handshakeHandler(boost::system::error_code ec)
+{
+	if (ec) {
+		fail(ec);
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_pool->m_mutex);
+		m_pool->saveSession(m_pool->m_hosts[createKey(m_host, m_port)], *m_stream);
+	}
+	m_handler(ec, std::move(m_stream), false);
+}
+
+void ConnectionPool::Connector::fail(boost::system::error_code ec)
+{
+	//may fail before first async operation, keep handler off the caller's stack
+	boost::asio::post(
+		m_pool->m_ioc,
+		std::bind(
+			m_handler,
+			ec,
+			nullptr,
+			false
+		)
+	);
+}
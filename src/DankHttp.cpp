@@ -4,96 +4,95 @@
 
 namespace DankHttp
 {
-	NuulsUploader::NuulsUploader(boost::asio::io_context & ioc) :
-		m_ioc(ioc),
-		m_ctx{ boost::asio::ssl::context::sslv23_client },
-		m_resolver(ioc)
+	NuulsUploader::NuulsUploader(std::shared_ptr<ConnectionPool> pool) :
+		m_pool(std::move(pool))
 	{
-		load_root_certificates(m_ctx);
-		m_stream_ptr = std::make_unique<boost::asio::ssl::stream<boost::asio::ip::tcp::socket>>(m_ioc, m_ctx);
 	}
 
-	std::string NuulsUploader::packBody(const std::string & data)
+	void NuulsUploader::run(CallbackType callback, const std::string & data, const std::string & host, const std::string & port, const std::string & target, int version)
 	{
-		std::string body;
-		//body.append(crlf);
-		body.append("--").append(boundary).append(crlf);
-		body.append("Content-Disposition: form-data; name=xddd; filename=xddd.png").append(crlf);
-		body.append("Content-Type: text/plain").append(crlf);
-		body.append(crlf);
-		body.append(data).append(crlf);
-		body.append("--").append(boundary).append("--");
-		return body;
+		auto shared_data = std::make_shared<const std::string>(data);
+		auto generator_factory = [shared_data]() -> GeneratorType {
+			return [shared_data, done = false](std::string & buffer) mutable {
+				if (done) return false;
+				buffer.append(*shared_data);
+				done = true;
+				return true;
+			};
+		};
+		run(std::move(callback), std::move(generator_factory), host, port, target, version);
 	}
 
-	void NuulsUploader::run(CallbackType callback, const std::string & data, const std::string & host, const std::string & port, const std::string & target, int version)
+	void NuulsUploader::run(CallbackType callback, GeneratorFactoryType generator_factory, const std::string & host, const std::string & port, const std::string & target, int version)
 	{
 		m_host = host;
 		m_port = port;
 		m_target = target;
 		m_version = version;
 		m_callback = callback;
-
-		if (!SSL_set_tlsext_host_name(m_stream_ptr->native_handle(), host.c_str())) {
-			boost::system::error_code ec{ static_cast<int>(::ERR_get_error()), boost::asio::error::get_ssl_category() };
-			std::cerr << ec.message() << "\n";
-			return;
-		}
-
-		std::string body = packBody(data);
+		m_generator_factory = std::move(generator_factory);
 
 		m_request.version(m_version);
 		m_request.set(boost::beast::http::field::host, m_host);
 		m_request.target(m_target);
 		m_request.set(boost::beast::http::field::user_agent, BOOST_BEAST_VERSION_STRING);
 		m_request.method(boost::beast::http::verb::post);
-		m_request.set(boost::beast::http::field::content_length, std::to_string(body.size()));
 		m_request.set(boost::beast::http::field::content_type, std::string("multipart/form-data; boundary=").append(boundary));
-		m_request.body() = std::move(body);
+		m_request.chunked(true);
+		//request is a member, this outlives it
+		m_request.body().generator = std::bind(&NuulsUploader::generateBody, this, std::placeholders::_1);
 
-		m_resolver.async_resolve(
-			m_host,
-			m_port,
-			std::bind(
-				&NuulsUploader::resolveHandler,
-				shared_from_this(),
-				std::placeholders::_1,
-				std::placeholders::_2
-			)
-		);
+		acquire();
 	}
 
-	void NuulsUploader::resolveHandler(boost::system::error_code ec, boost::asio::ip::tcp::resolver::results_type results)
+	bool NuulsUploader::generateBody(std::string & buffer)
 	{
-		if (ec) throw std::runtime_error(ec.message());
-		boost::asio::async_connect(
-			m_stream_ptr->next_layer(),
-			results.begin(),
-			results.end(),
-			std::bind(
-				&NuulsUploader::connectHandler,
-				shared_from_this(),
-				std::placeholders::_1
-			)
-		);
+		switch (m_body_stage) {
+		case BodyStage::preamble:
+			buffer.append("--").append(boundary).append(crlf);
+			buffer.append("Content-Disposition: form-data; name=xddd; filename=xddd.png").append(crlf);
+			buffer.append("Content-Type: text/plain").append(crlf);
+			buffer.append(crlf);
+			m_body_stage = BodyStage::data;
+			return true;
+		case BodyStage::data:
+			if (m_generator && m_generator(buffer)) return true;
+			m_body_stage = BodyStage::epilogue;
+			return true;
+		case BodyStage::epilogue:
+			buffer.append(crlf);
+			buffer.append("--").append(boundary).append("--");
+			m_body_stage = BodyStage::done;
+			return true;
+		default:
+			return false;
+		}
 	}
 
-	void NuulsUploader::connectHandler(boost::system::error_code ec)
+	void NuulsUploader::acquire()
 	{
-		if (ec) throw std::runtime_error(ec.message());
-		m_stream_ptr->async_handshake(
-			ssl::stream_base::client,
+		m_pool->acquire(
+			m_host,
+			m_port,
 			std::bind(
-				&NuulsUploader::handshakeHandler,
+				&NuulsUploader::acquireHandler,
 				shared_from_this(),
-				std::placeholders::_1
+				std::placeholders::_1,
+				std::placeholders::_2,
+				std::placeholders::_3
 			)
 		);
 	}
 
-	void NuulsUploader::handshakeHandler(boost::system::error_code ec)
+	void NuulsUploader::acquireHandler(boost::system::error_code ec, ConnectionPool::StreamPtr stream, bool reused)
 	{
 		if (ec) throw std::runtime_error(ec.message());
+		m_stream_ptr = std::move(stream);
+		m_reused = reused;
+		m_buffer.consume(m_buffer.size());
+		m_response = {};
+		m_generator = m_generator_factory();
+		m_body_stage = BodyStage::preamble;
 		boost::beast::http::async_write(
 			*m_stream_ptr,
 			m_request,
@@ -108,7 +107,10 @@ namespace DankHttp
 
 	void NuulsUploader::writeHandler(boost::system::error_code ec, std::size_t bytes_transferred)
 	{
-		if (ec) throw std::runtime_error(ec.message());
+		if (ec) {
+			failureHandler(ec);
+			return;
+		}
 		boost::ignore_unused(bytes_transferred);
 		boost::beast::http::async_read(
 			*m_stream_ptr, 
@@ -125,23 +127,26 @@ namespace DankHttp
 
 	void NuulsUploader::readHandler(boost::system::error_code ec, std::size_t bytes_transferred)
 	{
-		if (ec) throw std::runtime_error(ec.message());
-		m_stream_ptr->async_shutdown(
-			std::bind(
-				&NuulsUploader::shutdownHandler,
-				shared_from_this(),
-				std::placeholders::_1
-			)
-		);
+		if (ec) {
+			failureHandler(ec);
+			return;
+		}
+		boost::ignore_unused(bytes_transferred);
+		if (m_response.keep_alive()) {
+			m_pool->release(m_host, m_port, std::move(m_stream_ptr));
+		}
+		m_stream_ptr.reset();
+		m_callback(std::move(m_response.body()));
 	}
 
-	void NuulsUploader::shutdownHandler(boost::system::error_code ec)
+	void NuulsUploader::failureHandler(boost::system::error_code ec)
 	{
-		if (ec && ec.value() != boost::asio::ssl::error::stream_truncated) throw std::runtime_error(ec.message());
-		m_callback(std::move(m_response.body()));
+		m_stream_ptr.reset();
+		if (m_reused) {
+			acquire();
+			return;
+		}
+		throw std::runtime_error(ec.message());
 	}
 
-
-
-
 }
\ No newline at end of file
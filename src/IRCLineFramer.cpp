@@ -0,0 +1,69 @@
+//IRCLineFramer.cpp
+
+#include "../include/IRCLineFramer.hpp"
+
+IRCLineFramer::IRCLineFramer(std::size_t capacity) :
+	m_buffer(capacity)
+{
+	assert(capacity > 0);
+}
+
+boost::asio::mutable_buffer IRCLineFramer::prepare()
+{
+	if (m_end == m_buffer.size()) {
+		if (m_begin > 0) {
+			compact();
+		}
+		else {
+			//single line larger than buffer
+			m_buffer.resize(m_buffer.size() * 2);
+		}
+	}
+	return boost::asio::buffer(m_buffer.data() + m_end, m_buffer.size() - m_end);
+}
+
+void IRCLineFramer::commit(std::size_t n)
+{
+	assert(m_end + n <= m_buffer.size());
+	m_end += n;
+}
+
+std::optional<std::string_view> IRCLineFramer::nextLine()
+{
+	//memchr is vectorized by the C library, only '\r' hits are inspected
+	while (m_scan < m_end) {
+		const char * first = m_buffer.data() + m_scan;
+		const char * cr = static_cast<const char*>(std::memchr(first, '\r', m_end - m_scan));
+		if (cr == nullptr) {
+			m_scan = m_end;
+			break;
+		}
+		std::size_t cr_pos = cr - m_buffer.data();
+		if (cr_pos + 1 == m_end) {
+			//'\n' not received yet
+			m_scan = cr_pos;
+			break;
+		}
+		if (m_buffer[cr_pos + 1] != '\n') {
+			m_scan = cr_pos + 1;
+			continue;
+		}
+		std::string_view line(m_buffer.data() + m_begin, cr_pos - m_begin);
+		m_begin = cr_pos + 2;
+		m_scan = m_begin;
+		return line;
+	}
+	return std::nullopt;
+}
+
+void IRCLineFramer::compact()
+{
+	if (m_begin == 0) return;
+	std::size_t remaining = m_end - m_begin;
+	if (remaining > 0) {
+		std::memmove(m_buffer.data(), m_buffer.data() + m_begin, remaining);
+	}
+	m_scan -= m_begin;
+	m_end = remaining;
+	m_begin = 0;
+}
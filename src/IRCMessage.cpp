@@ -2,178 +2,200 @@
 
 #include "../include/IRCMessage.hpp"
 
+IRCMessage::IRCMessage(const TimePoint time, std::string && buf) :
+	m_time(time)
+{
+	if (buf.size() > max_line_size) {
+		buf.resize(max_line_size);
+	}
+	m_storage = std::make_shared<const std::string>(std::move(buf));
+	m_data = m_storage->data();
+	m_size = static_cast<std::uint16_t>(m_storage->size());
+	parseImplementation();
+}
+
+IRCMessage::IRCMessage(const TimePoint time, std::string_view line) :
+	IRCMessage(time, std::string(line.substr(0, max_line_size)))
+{
+}
+
+IRCMessage::IRCMessage(const TimePoint time, Storage storage, std::string_view line) :
+	m_time(time),
+	m_storage(std::move(storage)),
+	m_data(line.data()),
+	m_size(static_cast<std::uint16_t>(std::min(line.size(), max_line_size)))
+{
+	assert(m_data >= m_storage->data() && m_data + m_size <= m_storage->data() + m_storage->size());
+	parseImplementation();
+}
+
 void IRCMessage::parseImplementation()
 {
-	std::string_view data_view(m_data);
-	std::size_t space = 0;
+	std::string_view data_view(m_data, m_size);
+
+	auto span = [this](std::string_view v) {
+		return Span{ static_cast<std::uint16_t>(v.data() - m_data), static_cast<std::uint16_t>(v.size()) };
+	};
+	auto extract_word = [&data_view]() {
+		std::size_t space = data_view.find(' ');
+		std::string_view word = data_view.substr(0, space);
+		data_view.remove_prefix(space == data_view.npos ? data_view.size() : space + 1);
+		return word;
+	};
+
+	if (data_view.empty()) return;
+
+	//tags, only the span is recorded
+	if (data_view[0] == '@') {
+		m_tags = span(extract_word().substr(1));
+
+		if (data_view.empty()) return;
+	}
 
 	//prefix
 	if (data_view[0] == ':') {
-		space = data_view.find_first_of(' ');
-		std::string_view prefix_view = data_view.substr(1, space);
+		std::string_view prefix_view = extract_word().substr(1);
 
-		std::size_t at = prefix_view.find_first_of('@');
+		std::size_t at = prefix_view.find('@');
 		if (at != prefix_view.npos) {
-			std::size_t ex = prefix_view.find_first_of('!');
-			if (ex != prefix_view.npos) {
-				m_nick_view = prefix_view.substr(0, ex);
-				m_user_view = prefix_view.substr(ex + 1, at - ex - 1);
-				m_host_view = prefix_view.substr(at + 1);
+			std::size_t ex = prefix_view.find('!');
+			if (ex != prefix_view.npos && ex < at) {
+				m_nick = span(prefix_view.substr(0, ex));
+				m_user = span(prefix_view.substr(ex + 1, at - ex - 1));
+				m_host = span(prefix_view.substr(at + 1));
 			}
 			else {
-				m_nick_view = prefix_view.substr(0, at);
-				m_host_view = prefix_view.substr(at + 1);
+				m_nick = span(prefix_view.substr(0, at));
+				m_host = span(prefix_view.substr(at + 1));
 			}
 		}
 		else {
-			m_nick_view = prefix_view;
+			m_nick = span(prefix_view);
 		}
 
-		data_view.remove_prefix(space + 1);
 		if (data_view.empty()) return;
 	}
 
 	//command
-	{
-		space = data_view.find_first_of(' ');
-		m_command_view = data_view.substr(0, space);
-
-		data_view.remove_prefix(space + 1);
-		if (data_view.empty()) return;
-	}
+	m_command = span(extract_word());
+	if (data_view.empty()) return;
 
 	//params
-	{
-		while (!data_view.empty()) {
-			if (data_view[0] == ':') break;
-			space = data_view.find_first_of(' ');
-			if (space == data_view.npos) {
-				m_params_vec.push_back(data_view);
-				data_view.remove_prefix(data_view.size());
-				break;
-			}
-			else {
-				m_params_vec.push_back(data_view.substr(0, space));
-				data_view.remove_prefix(space + 1);
-			}
+	while (!data_view.empty() && data_view[0] != ':') {
+		if (m_params_count == max_params - 1) {
+			//last param takes the rest of the line
+			m_params[m_params_count++] = span(data_view);
+			return;
 		}
-		if (data_view.empty()) return;
+		m_params[m_params_count++] = span(extract_word());
 	}
+	if (data_view.empty()) return;
 
 	//body
-	if (data_view[0] == ':') {
-		m_body_view = data_view.substr(1);
-	}
+	m_body = span(data_view.substr(1));
 }
 
-void IRCMessage::copyImplementation(const IRCMessage & source)
+std::string_view IRCMessage::view(const Span & span) const
 {
-	//copy time
-	m_time = source.m_time;
-
-	//copy data string
-	m_data = source.m_data;
-
-	//create new string_views relative to m_data
-	{
-		auto & source_view = source.m_nick_view;
-		assert(source_view.data() >= source.m_data.data());
-		std::ptrdiff_t distance = source_view.data() - source.m_data.data();
-		m_nick_view = std::string_view(m_data.data() + distance, source_view.size());
-	}
-	{
-		auto & source_view = source.m_user_view;
-		assert(source_view.data() >= source.m_data.data());
-		std::ptrdiff_t distance = source_view.data() - source.m_data.data();
-		m_user_view = std::string_view(m_data.data() + distance, source_view.size());
-	}
-	{
-		auto & source_view = source.m_host_view;
-		assert(source_view.data() >= source.m_data.data());
-		std::ptrdiff_t distance = source_view.data() - source.m_data.data();
-		m_host_view = std::string_view(m_data.data() + distance, source_view.size());
-	}
-	{
-		auto & source_view = source.m_command_view;
-		assert(source_view.data() >= source.m_data.data());
-		std::ptrdiff_t distance = source_view.data() - source.m_data.data();
-		m_command_view = std::string_view(m_data.data() + distance, source_view.size());
-	}
-	{
-		auto & source_vec = source.m_params_vec;
-		m_params_vec.reserve(source_vec.size());
-		for (auto & e : source_vec) {
-			assert(e.data() >= source.m_data.data());
-			std::ptrdiff_t distance = e.data() - source.m_data.data();
-			m_params_vec.emplace_back(m_data.data() + distance, e.size());
-		}
-	}
-	{
-		auto & source_view = source.m_body_view;
-		assert(source_view.data() >= source.m_data.data());
-		std::ptrdiff_t distance = source_view.data() - source.m_data.data();
-		m_body_view = std::string_view(m_data.data() + distance, source_view.size());
-	}
+	return std::string_view(m_data + span.offset, span.size);
 }
 
 void IRCMessage::print(std::ostream & stream)
 {
 	stream
-		<< "nick: " << m_nick_view << "\n"
-		<< "user: " << m_user_view << "\n"
-		<< "host: " << m_host_view << "\n"
-		<< "command: " << m_command_view << "\n"
-		<< "params: " << [](auto & vec)->std::string {std::string str; std::for_each(vec.begin(), vec.end(), [&](auto & s) {str.append(std::string(s) + ", "); }); return str; }(m_params_vec) << "\n"
-		<< "body: " << m_body_view << "\n";
+		<< "tags: " << getTags() << "\n"
+		<< "nick: " << getNick() << "\n"
+		<< "user: " << getUser() << "\n"
+		<< "host: " << getHost() << "\n"
+		<< "command: " << getCommand() << "\n"
+		<< "params: " << [](auto params)->std::string {std::string str; std::for_each(params.begin(), params.end(), [&](auto s) {str.append(std::string(s) + ", "); }); return str; }(getParams()) << "\n"
+		<< "body: " << getBody() << "\n";
+}
+
+const IRCMessage::TimePoint & IRCMessage::getTime() const
+{
+	return m_time;
 }
 
-IRCMessage::IRCMessage(const IRCMessage & source)
+std::string_view IRCMessage::getData() const
 {
-	copyImplementation(source);
+	return std::string_view(m_data, m_size);
 }
 
-IRCMessage & IRCMessage::operator=(const IRCMessage & source)
+std::string_view IRCMessage::getNick() const
 {
-	copyImplementation(source);
-	return *this;
+	return view(m_nick);
 }
 
-const IRCMessage::TimePoint & IRCMessage::getTime() const
+std::string_view IRCMessage::getUser() const
 {
-	return m_time;
+	return view(m_user);
 }
 
-const std::string & IRCMessage::getData() const
+std::string_view IRCMessage::getHost() const
 {
-	return m_data;
+	return view(m_host);
 }
 
-const std::string_view & IRCMessage::getNick() const
+std::string_view IRCMessage::getCommand() const
 {
-	return m_nick_view;
+	return view(m_command);
 }
 
-const std::string_view & IRCMessage::getUser() const
+IRCMessage::Params IRCMessage::getParams() const
 {
-	return m_user_view;
+	return Params(m_data, m_params.data(), m_params_count);
 }
 
-const std::string_view & IRCMessage::getHost() const
+std::string_view IRCMessage::getBody() const
 {
-	return m_host_view;
+	return view(m_body);
 }
 
-const std::string_view & IRCMessage::getCommand() const
+std::string_view IRCMessage::getTags() const
 {
-	return m_command_view;
+	return view(m_tags);
 }
 
-const std::vector<std::string_view>& IRCMessage::getParams() const
+std::optional<std::string_view> IRCMessage::getTagView(std::string_view key) const
 {
-	return m_params_vec;
+	std::string_view tags_view = getTags();
+	while (!tags_view.empty()) {
+		std::size_t semicolon = tags_view.find(';');
+		std::string_view tag = tags_view.substr(0, semicolon);
+		tags_view.remove_prefix(semicolon == tags_view.npos ? tags_view.size() : semicolon + 1);
+		if (tag.size() >= key.size() && tag.compare(0, key.size(), key) == 0) {
+			if (tag.size() == key.size()) {
+				return std::string_view();
+			}
+			else if (tag[key.size()] == '=') {
+				return tag.substr(key.size() + 1);
+			}
+		}
+	}
+	return std::nullopt;
 }
 
-const std::string_view & IRCMessage::getBody() const
+std::optional<std::string> IRCMessage::getTag(std::string_view key) const
 {
-	return m_body_view;
+	auto value = getTagView(key);
+	if (!value) return std::nullopt;
+	std::string str;
+	str.reserve(value->size());
+	for (std::size_t i = 0; i < value->size(); ++i) {
+		char c = (*value)[i];
+		if (c != '\\') {
+			str.push_back(c);
+			continue;
+		}
+		if (++i == value->size()) break; //trailing '\' is dropped
+		switch ((*value)[i]) {
+		case ':': str.push_back(';'); break;
+		case 's': str.push_back(' '); break;
+		case 'r': str.push_back('\r'); break;
+		case 'n': str.push_back('\n'); break;
+		default: str.push_back((*value)[i]); break;
+		}
+	}
+	return str;
 }
@@ -3,47 +3,91 @@
 #include "../include/IRCMessageBuffer.hpp"
 
 IRCMessageBuffer::IRCMessageBuffer(std::size_t size) :
-	m_capacity(size)
+	m_capacity(size),
+	m_slots(new Slot[size])
 {
 	assert(size > 0);
 }
 
-void IRCMessageBuffer::push(IRCMessage && msg)
+void IRCMessageBuffer::push(const IRCMessage & msg)
 {
-	std::lock_guard<std::mutex> lock(m_mutex);
-	m_queue.push_back(std::move(msg));
-	if (m_queue.size() > m_capacity) {
-		m_queue.pop_front();
-		assert(m_queue.size() <= m_capacity);
+	std::string_view nick = msg.getNick();
+	std::string_view body = msg.getBody();
+	nick = nick.substr(0, max_text_size);
+	body = body.substr(0, max_text_size - nick.size());
+
+	std::uint64_t index = m_head.load(std::memory_order_relaxed);
+	Slot & slot = m_slots[index % m_capacity];
+	std::uint64_t sequence = slot.sequence.load(std::memory_order_relaxed);
+	slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+	//odd sequence is visible before any word changes
+	std::atomic_thread_fence(std::memory_order_release);
+
+	slot.words[0].store(index, std::memory_order_relaxed);
+	slot.words[1].store(static_cast<std::uint64_t>(msg.getTime().time_since_epoch().count()), std::memory_order_relaxed);
+	slot.words[2].store(nick.size() | (body.size() << 16), std::memory_order_relaxed);
+
+	//pack nick and body into words without a temporary string
+	std::size_t text_size = nick.size() + body.size();
+	for (std::size_t w = 0; w * sizeof(std::uint64_t) < text_size; ++w) {
+		char bytes[sizeof(std::uint64_t)] = {};
+		for (std::size_t b = 0; b < sizeof(std::uint64_t); ++b) {
+			std::size_t i = w * sizeof(std::uint64_t) + b;
+			if (i >= text_size) break;
+			bytes[b] = i < nick.size() ? nick[i] : body[i - nick.size()];
+		}
+		std::uint64_t word;
+		std::memcpy(&word, bytes, sizeof(word));
+		slot.words[header_words + w].store(word, std::memory_order_relaxed);
 	}
+
+	slot.sequence.store(sequence + 2, std::memory_order_release);
+	m_head.store(index + 1, std::memory_order_release);
 }
 
-void IRCMessageBuffer::accessData(IRCMessageBuffer::AccessDataFunc func)
+IRCMessageBuffer::LinesFromNowVecType IRCMessageBuffer::copyLinesFromNow(std::size_t line_count) const
 {
-	std::lock_guard<std::mutex> lock(m_mutex);
-	func(m_queue);
+	LinesFromNowVecType lines;
+	std::uint64_t head = m_head.load(std::memory_order_acquire);
+	std::uint64_t count = std::min<std::uint64_t>({ line_count, head, m_capacity });
+	lines.reserve(count);
+	std::vector<std::uint64_t> buffer(text_words);
+	Line line;
+	for (std::uint64_t index = head - count; index < head; ++index) {
+		//lines overwritten by a newer push are skipped
+		if (readSlot(index, line, buffer.data())) {
+			lines.push_back(std::move(line));
+		}
+	}
+	return lines;
 }
 
-void IRCMessageBuffer::accessLinesFromNow(std::size_t line_count, LinesFromNowFuncType func)
+bool IRCMessageBuffer::readSlot(std::uint64_t index, Line & line, std::uint64_t * buffer) const
 {
-	if (line_count == 0) return; //!!!
-
-	accessData([&](const IRCMessageBuffer::Container & queue)
-	{
-		LinesFromNowVecType lines_from_now;
-		lines_from_now.reserve(line_count);
-		std::size_t j = line_count - 1;
-		for (std::size_t i = 0; i < line_count; ++i) {
-			if (queue.size() > i) {
-				const IRCMessage & irc_msg = *(queue.crbegin() + i);
-				lines_from_now.push_back(irc_msg);
-			}
-			else {
-				break;
-			}
-		}
-		std::reverse(lines_from_now.begin(), lines_from_now.end());
-		func(lines_from_now);
+	const Slot & slot = m_slots[index % m_capacity];
+	std::uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+	if (sequence & 1) return false;
+
+	std::uint64_t slot_index = slot.words[0].load(std::memory_order_relaxed);
+	std::uint64_t time = slot.words[1].load(std::memory_order_relaxed);
+	std::uint64_t sizes = slot.words[2].load(std::memory_order_relaxed);
+	//sizes may be torn, keep copy in bounds until the sequence is checked
+	std::size_t nick_size = std::min<std::size_t>(sizes & 0xFFFF, max_text_size);
+	std::size_t body_size = std::min<std::size_t>((sizes >> 16) & 0xFFFF, max_text_size - nick_size);
+	std::size_t words = (nick_size + body_size + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t);
+	for (std::size_t w = 0; w < words; ++w) {
+		buffer[w] = slot.words[header_words + w].load(std::memory_order_relaxed);
 	}
-	);
+
+	//copies are done before the sequence is read again
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (slot.sequence.load(std::memory_order_relaxed) != sequence || slot_index != index) {
+		return false;
+	}
+
+	const char * text = reinterpret_cast<const char*>(buffer);
+	line.time = TimePoint(TimePoint::duration(static_cast<TimePoint::rep>(time)));
+	line.nick.assign(text, nick_size);
+	line.body.assign(text + nick_size, body_size);
+	return true;
 }
@@ -1,6 +1,7 @@
 //Log.cpp
 
 #include "../include/Log.hpp"
+#include "../include/LogArchive.hpp"
 
 Log::Log(TimeDetail::TimePeriod && period, ChannelName && channel_name, std::string && data, ParserFunc parser) :
 	m_period(std::move(period)),
@@ -8,6 +9,59 @@ Log::Log(TimeDetail::TimePeriod && period, ChannelName && channel_name, std::str
 	m_data(std::move(data))
 {
 	m_valid = parser(m_data, m_lines);
+	checkSorted();
+}
+
+Log::Log(TimeDetail::TimePeriod && period, ChannelName && channel_name, std::shared_ptr<const LogArchive> archive) :
+	m_valid(archive != nullptr),
+	m_period(std::move(period)),
+	m_channel_name(std::move(channel_name)),
+	m_archive(std::move(archive)),
+	m_archive_size(m_archive ? m_archive->size() : 0)
+{
+	checkSorted();
+}
+
+Log::Log(TimeDetail::TimePeriod && period, ChannelName && channel_name, std::shared_ptr<const LogArchive> archive, std::size_t first, std::size_t last) :
+	m_valid(archive != nullptr),
+	m_period(std::move(period)),
+	m_channel_name(std::move(channel_name)),
+	m_archive(std::move(archive)),
+	m_archive_first(first),
+	m_archive_size(last - first)
+{
+	assert(first <= last && (!m_archive || last <= m_archive->size()));
+	checkSorted();
+}
+
+Log::Log(Log && source) :
+	m_valid(source.m_valid),
+	m_sorted(source.m_sorted),
+	m_period(source.m_period),
+	m_channel_name(std::move(source.m_channel_name)),
+	m_lines(std::move(source.m_lines)),
+	m_archive(std::move(source.m_archive)),
+	m_archive_first(source.m_archive_first),
+	m_archive_size(source.m_archive_size)
+{
+	const char * old_begin = source.m_data.data();
+	const char * old_end = old_begin + source.m_data.size();
+	m_data = std::move(source.m_data);
+	if (m_data.data() != old_begin) {
+		auto rebase = [&](std::string_view view) {
+			if (view.data() < old_begin || view.data() > old_end) return view;
+			return std::string_view(m_data.data() + (view.data() - old_begin), view.size());
+		};
+		for (auto & line : m_lines) {
+			line = LineView(
+				rebase(line.getLineView()),
+				rebase(line.getTimeView()),
+				line.getTime(),
+				rebase(line.getNameView()),
+				rebase(line.getMessageView())
+			);
+		}
+	}
 }
 
 bool Log::isValid() const
@@ -35,7 +89,91 @@ const std::vector<Log::LineView> & Log::getLines() const
 	return m_lines;
 }
 
+const std::shared_ptr<const LogArchive> & Log::getArchive() const
+{
+	return m_archive;
+}
+
 std::size_t Log::getNumberOfLines() const
 {
-	return m_lines.size();
+	return m_archive ? m_archive_size : m_lines.size();
+}
+
+TimeDetail::TimePoint Log::getTime(std::size_t i) const
+{
+	return m_archive ? m_archive->getTime(m_archive_first + i) : m_lines[i].getTime();
+}
+
+std::string_view Log::getName(std::size_t i) const
+{
+	return m_archive ? m_archive->getName(m_archive_first + i) : m_lines[i].getNameView();
+}
+
+std::string_view Log::getMessage(std::size_t i) const
+{
+	return m_archive ? m_archive->getMessage(m_archive_first + i) : m_lines[i].getMessageView();
+}
+
+Log::Line Log::getLine(std::size_t i) const
+{
+	if (m_archive) {
+		return Line(getTime(i), getName(i), getMessage(i));
+	}
+	return Line(m_lines[i]);
+}
+
+const TokenIndex * Log::getTokenIndex() const
+{
+	return m_archive ? m_archive->getTokenIndex() : nullptr;
+}
+
+std::size_t Log::getArchiveFirst() const
+{
+	return m_archive_first;
+}
+
+bool Log::isSorted() const
+{
+	return m_sorted;
+}
+
+std::pair<std::size_t, std::size_t> Log::getLineRange(const TimeDetail::TimePeriod & period) const
+{
+	if (!m_sorted) {
+		return { 0, getNumberOfLines() };
+	}
+	return { lowerBound(period.begin()), lowerBound(period.end()) };
+}
+
+void Log::checkSorted()
+{
+	if (m_archive) {
+		m_sorted = m_archive->isSortedByTime();
+		return;
+	}
+	m_sorted = true;
+	std::size_t size = getNumberOfLines();
+	for (std::size_t i = 1; i < size; ++i) {
+		if (getTime(i) < getTime(i - 1)) {
+			m_sorted = false;
+			return;
+		}
+	}
+}
+
+std::size_t Log::lowerBound(TimeDetail::TimePoint point) const
+{
+	std::size_t first = 0;
+	std::size_t count = getNumberOfLines();
+	while (count > 0) {
+		std::size_t step = count / 2;
+		if (getTime(first + step) < point) {
+			first += step + 1;
+			count -= step + 1;
+		}
+		else {
+			count = step;
+		}
+	}
+	return first;
 }
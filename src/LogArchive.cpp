@@ -0,0 +1,189 @@
+//LogArchive.cpp
+
+#include "../include/LogArchive.hpp"
+
+namespace
+{
+	const char archive_magic[8] = { 'S', 'B', 'L', 'O', 'G', 'A', 'R', 'C' };
+
+	std::uint64_t align8(std::uint64_t n)
+	{
+		return (n + 7) & ~std::uint64_t(7);
+	}
+
+	template <typename T>
+	void writeColumn(std::ostream & stream, const std::vector<T> & vec)
+	{
+		stream.write(reinterpret_cast<const char*>(vec.data()), vec.size() * sizeof(T));
+	}
+
+	void writePadding(std::ostream & stream, std::uint64_t n)
+	{
+		const char zero[8] = {};
+		stream.write(zero, align8(n) - n);
+	}
+}
+
+LogArchive::Layout LogArchive::computeLayout(const Header & header)
+{
+	Layout layout;
+	layout.times = sizeof(Header);
+	layout.user_ids = layout.times + header.line_count * sizeof(std::int64_t);
+	layout.user_offsets = align8(layout.user_ids + header.line_count * sizeof(std::uint32_t));
+	layout.user_blob = layout.user_offsets + (header.user_count + 1) * sizeof(std::uint64_t);
+	layout.message_offsets = align8(layout.user_blob + header.user_blob_size);
+	layout.message_blob = layout.message_offsets + (header.line_count + 1) * sizeof(std::uint64_t);
+	layout.end = layout.message_blob + header.message_blob_size;
+	return layout;
+}
+
+std::shared_ptr<const LogArchive> LogArchive::open(const std::filesystem::path & path, std::uint64_t offset)
+{
+	namespace bip = boost::interprocess;
+
+	std::error_code ec;
+	std::uintmax_t file_size = std::filesystem::file_size(path, ec);
+	if (ec || file_size < offset + sizeof(Header)) return nullptr;
+
+	std::shared_ptr<LogArchive> archive(new LogArchive());
+	try {
+		archive->m_file = bip::file_mapping(path.string().c_str(), bip::read_only);
+		archive->m_region = bip::mapped_region(archive->m_file, bip::read_only, offset, file_size - offset);
+	}
+	catch (bip::interprocess_exception &) {
+		return nullptr;
+	}
+
+	const char * base = static_cast<const char*>(archive->m_region.get_address());
+	const Header * header = reinterpret_cast<const Header*>(base);
+	if (std::memcmp(header->magic, archive_magic, sizeof(header->magic)) != 0 || header->version != version) {
+		return nullptr;
+	}
+	Layout layout = computeLayout(*header);
+	if (layout.end > file_size - offset) {
+		return nullptr;
+	}
+
+	archive->m_header = header;
+	archive->m_times = reinterpret_cast<const std::int64_t*>(base + layout.times);
+	archive->m_user_ids = reinterpret_cast<const std::uint32_t*>(base + layout.user_ids);
+	archive->m_user_offsets = reinterpret_cast<const std::uint64_t*>(base + layout.user_offsets);
+	archive->m_user_blob = base + layout.user_blob;
+	archive->m_message_offsets = reinterpret_cast<const std::uint64_t*>(base + layout.message_offsets);
+	archive->m_message_blob = base + layout.message_blob;
+
+	//offsets must stay inside their blobs
+	if (archive->m_user_offsets[header->user_count] != header->user_blob_size ||
+		archive->m_message_offsets[header->line_count] != header->message_blob_size) {
+		return nullptr;
+	}
+
+	if (header->flags & Flags::has_token_index) {
+		std::uint64_t index_offset = align8(layout.end);
+		if (index_offset <= file_size - offset) {
+			archive->m_token_index = TokenIndex::view(base + index_offset, file_size - offset - index_offset);
+		}
+		if (archive->m_token_index && archive->m_token_index->getNumberOfLines() != header->line_count) {
+			archive->m_token_index.reset();
+		}
+	}
+	return archive;
+}
+
+LogArchive::Builder::Builder(const std::filesystem::path & spill_path, bool token_index) :
+	m_spill_path(spill_path),
+	m_spill(spill_path, std::ios::trunc | std::ios::out | std::ios::binary)
+{
+	if (token_index) {
+		m_token_index.emplace();
+	}
+}
+
+LogArchive::Builder::~Builder()
+{
+	m_spill.close();
+	std::error_code ec;
+	std::filesystem::remove(m_spill_path, ec);
+}
+
+void LogArchive::Builder::append(const Log & log)
+{
+	const std::size_t line_count = log.getNumberOfLines();
+	m_times.reserve(m_times.size() + line_count);
+	m_user_ids.reserve(m_user_ids.size() + line_count);
+	m_message_offsets.reserve(m_message_offsets.size() + line_count);
+
+	for (std::size_t i = 0; i < line_count; ++i) {
+		std::int64_t time = std::chrono::duration_cast<std::chrono::seconds>(log.getTime(i).time_since_epoch()).count();
+		if (!m_times.empty() && time < m_times.back()) {
+			m_sorted = false;
+		}
+		m_times.push_back(time);
+
+		std::string_view name = log.getName(i);
+		m_name_key.assign(name.data(), name.size());
+		auto it = m_user_map.find(m_name_key);
+		if (it == m_user_map.end()) {
+			it = m_user_map.emplace(name, static_cast<std::uint32_t>(m_user_offsets.size() - 1)).first;
+			m_user_blob.append(name);
+			m_user_offsets.push_back(m_user_blob.size());
+		}
+		m_user_ids.push_back(it->second);
+
+		std::string_view message = log.getMessage(i);
+		m_spill.write(message.data(), message.size());
+		m_message_offsets.push_back(m_message_offsets.back() + message.size());
+	}
+
+	if (m_token_index) {
+		m_token_index->append(log);
+	}
+}
+
+bool LogArchive::Builder::write(std::ostream & stream)
+{
+	m_spill.flush();
+	if (m_spill.fail()) return false;
+
+	Header header;
+	std::memcpy(header.magic, archive_magic, sizeof(header.magic));
+	header.version = version;
+	header.flags = 0;
+	if (m_sorted) {
+		header.flags |= Flags::sorted_by_time;
+	}
+	if (m_token_index) {
+		header.flags |= Flags::has_token_index;
+	}
+	header.line_count = m_times.size();
+	header.user_count = m_user_offsets.size() - 1;
+	header.user_blob_size = m_user_blob.size();
+	header.message_blob_size = m_message_offsets.back();
+
+	Layout layout = computeLayout(header);
+
+	stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	writeColumn(stream, m_times);
+	writeColumn(stream, m_user_ids);
+	writePadding(stream, layout.user_ids + m_user_ids.size() * sizeof(std::uint32_t));
+	writeColumn(stream, m_user_offsets);
+	stream.write(m_user_blob.data(), m_user_blob.size());
+	writePadding(stream, layout.user_blob + m_user_blob.size());
+	writeColumn(stream, m_message_offsets);
+
+	std::ifstream spill(m_spill_path, std::ios::in | std::ios::binary);
+	if (!spill.is_open()) return false;
+	std::vector<char> buffer(64 * 1024);
+	std::uint64_t copied = 0;
+	while (spill.read(buffer.data(), buffer.size()) || spill.gcount() > 0) {
+		stream.write(buffer.data(), spill.gcount());
+		copied += static_cast<std::uint64_t>(spill.gcount());
+	}
+	if (copied != header.message_blob_size) return false;
+
+	if (m_token_index) {
+		writePadding(stream, layout.end);
+		if (!m_token_index->write(stream)) return false;
+	}
+	return !stream.fail();
+}
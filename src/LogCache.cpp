@@ -0,0 +1,231 @@
+//LogCache.cpp
+
+#include "../include/LogCache.hpp"
+
+namespace
+{
+	const std::string_view cache_magic("SaivBotLogCache2");
+	const std::string_view cache_extension(".log");
+	const std::string_view temp_marker(".tmp");
+}
+
+LogCache::LogCache(const std::filesystem::path & directory, std::uintmax_t max_size, Duration open_period_ttl, bool token_index) :
+	m_directory(directory),
+	m_max_size(max_size),
+	m_open_period_ttl(open_period_ttl),
+	m_token_index(token_index)
+{
+	std::error_code ec;
+	std::filesystem::create_directories(m_directory, ec);
+	if (ec) throw std::runtime_error("Can't create log cache directory");
+
+	//oldest first so the newest files end up at the front of m_lru
+	std::vector<std::filesystem::directory_entry> files;
+	std::vector<std::filesystem::path> stray;
+	std::string temp_infix = std::string(cache_extension).append(temp_marker);
+	for (auto & e : std::filesystem::directory_iterator(m_directory)) {
+		if (!e.is_regular_file()) continue;
+		if (e.path().extension() == cache_extension) {
+			files.push_back(e);
+		}
+		else if (e.path().filename().string().find(temp_infix) != std::string::npos) {
+			//left behind by a writer that never committed
+			stray.push_back(e.path());
+		}
+	}
+	for (auto & path : stray) {
+		std::filesystem::remove(path, ec);
+	}
+	std::sort(
+		files.begin(),
+		files.end(),
+		[](auto & a, auto & b) {return a.last_write_time() < b.last_write_time(); }
+	);
+	for (auto & e : files) {
+		std::string file_name = e.path().filename().string();
+		m_lru.push_front(file_name);
+		m_entries.emplace(file_name, Entry{ e.file_size(), m_lru.begin() });
+		m_size += e.file_size();
+	}
+	evict();
+}
+
+std::shared_ptr<const LogArchive> LogCache::load(std::string_view host, std::string_view target)
+{
+	std::string key = createKey(host, target);
+	std::string file_name = createFileName(key);
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_entries.find(file_name) == m_entries.end()) {
+			return nullptr;
+		}
+	}
+
+	std::uint64_t archive_offset = 0;
+	{
+		std::ifstream fs(m_directory / file_name, std::ios::in | std::ios::binary);
+		if (!fs.is_open()) return nullptr;
+
+		std::string magic;
+		std::string stored_key;
+		std::int64_t expires = 0;
+		std::getline(fs, magic);
+		std::getline(fs, stored_key);
+		fs >> expires;
+		fs.ignore(1);
+		if (fs.fail() || magic != cache_magic || stored_key != key) {
+			return nullptr;
+		}
+
+		if (expires != 0) {
+			auto now = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+			if (now >= expires) {
+				fs.close();
+				std::lock_guard<std::mutex> lock(m_mutex);
+				erase(file_name);
+				return nullptr;
+			}
+		}
+		archive_offset = alignHeader(static_cast<std::uint64_t>(fs.tellg()));
+	}
+
+	auto archive = LogArchive::open(m_directory / file_name, archive_offset);
+	if (!archive) return nullptr;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	touch(file_name);
+	return archive;
+}
+
+std::unique_ptr<LogCache::Writer> LogCache::createWriter(std::string_view host, std::string_view target, const TimeDetail::TimePeriod & period)
+{
+	std::string key = createKey(host, target);
+	std::string file_name = createFileName(key);
+
+	std::int64_t expires = 0;
+	auto now = std::chrono::system_clock::now();
+	if (period.end() > now) {
+		expires = std::chrono::duration_cast<std::chrono::seconds>((now + m_open_period_ttl).time_since_epoch()).count();
+	}
+	return std::unique_ptr<Writer>(new Writer(*this, std::move(key), std::move(file_name), expires));
+}
+
+void LogCache::store(std::string_view host, std::string_view target, const TimeDetail::TimePeriod & period, const Log & log)
+{
+	auto writer = createWriter(host, target, period);
+	writer->append(log);
+	writer->commit();
+}
+
+std::uint64_t LogCache::alignHeader(std::uint64_t header_size)
+{
+	return (header_size + 7) & ~std::uint64_t(7);
+}
+
+std::string LogCache::createKey(std::string_view host, std::string_view target)
+{
+	std::string key;
+	key.append(host).append(target);
+	//key is stored on its own line
+	std::replace(key.begin(), key.end(), '\n', ' ');
+	return key;
+}
+
+std::string LogCache::createFileName(const std::string & key)
+{
+	//FNV-1a 64
+	std::uint64_t h = 14695981039346656037ull;
+	for (char c : key) {
+		h ^= static_cast<unsigned char>(c);
+		h *= 1099511628211ull;
+	}
+	std::stringstream ss;
+	ss << std::hex << std::setw(16) << std::setfill('0') << h << cache_extension;
+	return ss.str();
+}
+
+std::filesystem::path LogCache::createTempPath(const std::string & file_name, std::string_view suffix)
+{
+	std::string name(file_name);
+	name.append(temp_marker).append(std::to_string(m_temp_counter++)).append(suffix);
+	return m_directory / name;
+}
+
+void LogCache::insert(const std::string & file_name, const std::filesystem::path & temp_path)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	erase(file_name);
+	std::error_code ec;
+	std::filesystem::rename(temp_path, m_directory / file_name, ec);
+	if (ec) {
+		std::filesystem::remove(temp_path, ec);
+		return;
+	}
+	std::uintmax_t size = std::filesystem::file_size(m_directory / file_name, ec);
+	if (ec) return;
+	m_lru.push_front(file_name);
+	m_entries.emplace(file_name, Entry{ size, m_lru.begin() });
+	m_size += size;
+	evict();
+}
+
+void LogCache::touch(const std::string & file_name)
+{
+	auto it = m_entries.find(file_name);
+	if (it == m_entries.end()) return;
+	m_lru.splice(m_lru.begin(), m_lru, it->second.lru_it);
+}
+
+void LogCache::erase(const std::string & file_name)
+{
+	auto it = m_entries.find(file_name);
+	if (it == m_entries.end()) return;
+	std::error_code ec;
+	std::filesystem::remove(m_directory / file_name, ec);
+	m_size -= it->second.size;
+	m_lru.erase(it->second.lru_it);
+	m_entries.erase(it);
+}
+
+void LogCache::evict()
+{
+	while (m_size > m_max_size && !m_lru.empty()) {
+		std::string file_name = m_lru.back();
+		erase(file_name);
+	}
+}
+
+LogCache::Writer::Writer(LogCache & cache, std::string && key, std::string && file_name, std::int64_t expires) :
+	m_cache(cache),
+	m_key(std::move(key)),
+	m_file_name(std::move(file_name)),
+	m_expires(expires),
+	m_builder(cache.createTempPath(m_file_name, ".msg"), cache.m_token_index)
+{
+}
+
+void LogCache::Writer::append(const Log & log)
+{
+	m_builder.append(log);
+}
+
+void LogCache::Writer::commit()
+{
+	//write to temporary file and rename so readers never see a partial file
+	std::filesystem::path temp_path = m_cache.createTempPath(m_file_name, "");
+	{
+		std::ofstream fs(temp_path, std::ios::trunc | std::ios::out | std::ios::binary);
+		if (!fs.is_open()) return;
+		fs << cache_magic << "\n" << m_key << "\n" << m_expires << "\n";
+		std::uint64_t header_size = static_cast<std::uint64_t>(fs.tellp());
+		const char zero[8] = {};
+		fs.write(zero, alignHeader(header_size) - header_size);
+		if (!m_builder.write(fs) || fs.fail()) {
+			fs.close();
+			std::error_code ec;
+			std::filesystem::remove(temp_path, ec);
+			return;
+		}
+	}
+	m_cache.insert(m_file_name, temp_path);
+}
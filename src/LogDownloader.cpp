@@ -213,177 +213,576 @@ bool GempirUserLogDownloader::parser(const std::string & data, std::vector<Log::
 }
 #endif
 
-LogDownloader::LogDownloader(boost::asio::io_context & ioc) :
-	m_ioc(ioc),
-	m_ctx{ boost::asio::ssl::context::sslv23_client },
-	m_resolver(ioc)
+LogDownloader::LogDownloader(std::shared_ptr<ConnectionPool> pool) :
+	m_pool(std::move(pool)),
+	m_ioc(m_pool->getIoContext())
 {
-	load_root_certificates(m_ctx);
-	m_stream.emplace(m_ioc, m_ctx);
-	m_http_response_parser.emplace();
-	m_http_response_parser->body_limit(std::numeric_limits<std::uint64_t>::max());
 }
 
 void LogDownloader::run(LogRequest && request)
 {
 	m_request = std::move(request);
 
-	if (!SSL_set_tlsext_host_name(m_stream->native_handle(), m_request.host.c_str())) {
-		boost::system::error_code ec{ static_cast<int>(::ERR_get_error()), boost::asio::error::get_ssl_category() };
-		std::cerr << ec.message() << "\n";
-		return;
-	}
-
-	m_resolver.async_resolve(
-		m_request.host,
-		m_request.port,
+	boost::asio::post(
+		m_ioc,
 		std::bind(
-			&LogDownloader::resolveHandler,
-			shared_from_this(),
-			std::placeholders::_1,
-			std::placeholders::_2
+			m_request.archiver ? &LogDownloader::archiveHandler : &LogDownloader::cacheHandler,
+			shared_from_this()
 		)
 	);
 }
 
+void LogDownloader::cacheHandler()
+{
+	if (m_request.cache) {
+		std::vector<LogRequest::Target> missing;
+		for (auto & target : m_request.targets) {
+			if (auto archive = m_request.cache->load(m_request.host, std::get<2>(target))) {
+				if (m_request.batch_callback && m_request.compute_pool) {
+					deliverSlices(std::move(std::get<0>(target)), std::move(std::get<1>(target)), std::move(archive));
+					continue;
+				}
+				Log log(std::move(std::get<0>(target)), std::move(std::get<1>(target)), std::move(archive));
+				if (m_request.batch_callback) {
+					m_request.batch_callback(std::move(log));
+					m_request.target_done_handler();
+				}
+				else {
+					m_request.callback(std::move(log));
+				}
+			}
+			else {
+				missing.push_back(std::move(target));
+			}
+		}
+		m_request.targets = std::move(missing);
+	}
+	if (m_request.targets.empty()) return;
+
+	startConnections();
+}
+
+void LogDownloader::archiveHandler()
+{
+	for (auto it = m_request.targets.begin(); it != m_request.targets.end(); ++it) {
+		auto task = [self = shared_from_this(), it]() {
+			auto & request = self->m_request;
+			Log log(std::move(std::get<0>(*it)), std::move(std::get<1>(*it)), request.archiver->read(std::get<2>(*it)), request.parser);
+			if (request.batch_callback) {
+				request.batch_callback(std::move(log));
+				request.target_done_handler();
+			}
+			else {
+				request.callback(std::move(log));
+			}
+		};
+		if (m_request.compute_pool) {
+			m_request.compute_pool->post(std::move(task));
+		}
+		else {
+			task();
+		}
+	}
+}
+
 void LogDownloader::errorHandler(boost::system::error_code ec)
 {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_failed) return;
+		m_failed = true;
+	}
 	m_request.error_handler();
 	std::stringstream ss;
 	ss << "LogDownloader error: " << ec.message();
 	throw std::runtime_error(ss.str());
 }
 
-void LogDownloader::resolveHandler(boost::system::error_code ec, boost::asio::ip::tcp::resolver::results_type results)
+void LogDownloader::startConnections()
 {
-	if (ec) {
-		errorHandler(ec);
+	std::size_t pipeline_depth = std::max<std::size_t>(1, m_request.pipeline_depth);
+	std::size_t wanted = (m_request.targets.size() + pipeline_depth - 1) / pipeline_depth;
+	wanted = std::max<std::size_t>(1, std::min(m_request.connections, wanted));
+	std::size_t count = acquireConnections(m_request.host, wanted, shared_from_this());
+	for (std::size_t i = 0; i < count; ++i) {
+		std::make_shared<Connection>(shared_from_this(), pipeline_depth)->run();
 	}
-	boost::asio::async_connect(
-		m_stream->next_layer(),
-		results.begin(),
-		results.end(),
-		std::bind(
-			&LogDownloader::connectHandler,
-			shared_from_this(),
-			std::placeholders::_1
-		)
-	);
 }
 
-void LogDownloader::connectHandler(boost::system::error_code ec)
+std::optional<LogRequest::TargetIterator> LogDownloader::popTarget()
 {
-	if (ec) {
-		errorHandler(ec);
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_failed) {
+		return std::nullopt;
 	}
-	m_stream->async_handshake(
-		ssl::stream_base::client,
-		std::bind(
-			&LogDownloader::handshakeHandler,
-			shared_from_this(),
-			std::placeholders::_1
-		)
-	);
+	if (!m_retry_targets.empty()) {
+		auto it = m_retry_targets.front();
+		m_retry_targets.pop_front();
+		return it;
+	}
+	if (m_next_target >= m_request.targets.size()) {
+		return std::nullopt;
+	}
+	return m_request.targets.begin() + m_next_target++;
 }
 
-void LogDownloader::handshakeHandler(boost::system::error_code ec)
+void LogDownloader::requeueTargets(const std::deque<LogRequest::TargetIterator> & targets)
 {
-	if (ec) {
-		errorHandler(ec);
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_retry_targets.insert(m_retry_targets.begin(), targets.begin(), targets.end());
+}
+
+bool LogDownloader::hasTargets()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return !m_failed && (!m_retry_targets.empty() || m_next_target < m_request.targets.size());
+}
+
+void LogDownloader::deliver(LogRequest::TargetIterator it, std::string && data, bool cacheable)
+{
+	Log log(std::move(std::get<0>(*it)), std::move(std::get<1>(*it)), std::move(data), m_request.parser);
+
+	if (m_request.cache && cacheable && log.isValid()) {
+		m_request.cache->store(m_request.host, std::get<2>(*it), log.getPeriod(), log);
 	}
-	auto it = m_request.targets.begin();
-	fillHttpRequest(*it);
-	boost::beast::http::async_write(
-		*m_stream,
-		m_http_request,
+	if (m_request.rollups && log.isValid()) {
+		auto writer = m_request.rollups->createWriter(log.getChannelName(), log.getPeriod(), std::get<3>(*it));
+		writer->append(log);
+		writer->commit();
+	}
+
+	m_request.callback(std::move(log));
+}
+
+void LogDownloader::deliverSlices(TimeDetail::TimePeriod && period, Log::ChannelName && channel_name, std::shared_ptr<const LogArchive> archive)
+{
+	std::size_t size = archive->size();
+	std::size_t slice_lines = std::max<std::size_t>(m_request.slice_lines, 1);
+	std::size_t slices = std::max<std::size_t>((size + slice_lines - 1) / slice_lines, 1);
+	auto remaining = std::make_shared<std::atomic<std::size_t>>(slices);
+	for (std::size_t i = 0; i < slices; ++i) {
+		std::size_t first = std::min(i * slice_lines, size);
+		std::size_t last = std::min(first + slice_lines, size);
+		m_request.compute_pool->post([self = shared_from_this(), period, channel_name, archive, first, last, remaining]() mutable {
+			self->m_request.batch_callback(Log(std::move(period), std::move(channel_name), std::move(archive), first, last));
+			if (remaining->fetch_sub(1, std::memory_order_acq_rel) == 1) {
+				self->m_request.target_done_handler();
+			}
+		});
+	}
+}
+
+void LogDownloader::startQueuedConnection()
+{
+	if (!hasTargets()) {
+		//nothing left to download, pass slot on
+		releaseConnection(m_request.host);
+		return;
+	}
+	std::make_shared<Connection>(shared_from_this(), std::max<std::size_t>(1, m_request.pipeline_depth))->run();
+}
+
+namespace
+{
+	struct HostConnections
+	{
+		std::size_t active = 0;
+		std::deque<std::shared_ptr<LogDownloader>> waiting;
+	};
+
+	std::mutex host_connections_mutex;
+	std::unordered_map<std::string, HostConnections> host_connections;
+}
+
+std::size_t LogDownloader::acquireConnections(const std::string & host, std::size_t wanted, std::shared_ptr<LogDownloader> downloader)
+{
+	std::lock_guard<std::mutex> lock(host_connections_mutex);
+	HostConnections & connections = host_connections[host];
+	std::size_t available = connections.active < max_connections_per_host ? max_connections_per_host - connections.active : 0;
+	std::size_t granted = std::min(wanted, available);
+	if (granted == 0) {
+		connections.waiting.push_back(std::move(downloader));
+	}
+	connections.active += granted;
+	return granted;
+}
+
+void LogDownloader::releaseConnection(const std::string & host)
+{
+	std::shared_ptr<LogDownloader> next;
+	{
+		std::lock_guard<std::mutex> lock(host_connections_mutex);
+		auto it = host_connections.find(host);
+		assert(it != host_connections.end() && it->second.active > 0);
+		if (!it->second.waiting.empty()) {
+			//slot is handed over, active is unchanged
+			next = std::move(it->second.waiting.front());
+			it->second.waiting.pop_front();
+		}
+		else if (--it->second.active == 0) {
+			host_connections.erase(it);
+		}
+	}
+	if (next) {
+		//not run inline, the releasing connection may be in the middle of a handler
+		boost::asio::post(next->m_ioc, std::bind(&LogDownloader::startQueuedConnection, next));
+	}
+}
+
+LogDownloader::Connection::Connection(std::shared_ptr<LogDownloader> downloader, std::size_t pipeline_depth) :
+	m_downloader(std::move(downloader)),
+	m_pipeline_depth(pipeline_depth),
+	m_strand(m_downloader->m_ioc)
+{
+}
+
+void LogDownloader::Connection::run()
+{
+	m_downloader->m_pool->acquire(
+		m_downloader->m_request.host,
+		m_downloader->m_request.port,
 		std::bind(
-			&LogDownloader::writeHandler,
+			&Connection::acquireHandler,
 			shared_from_this(),
 			std::placeholders::_1,
 			std::placeholders::_2,
-			it
+			std::placeholders::_3
 		)
 	);
 }
 
-void LogDownloader::writeHandler(boost::system::error_code ec, std::size_t bytes_transferred, LogRequest::TargetIterator it)
+void LogDownloader::Connection::acquireHandler(boost::system::error_code ec, ConnectionPool::StreamPtr stream, bool reused)
 {
 	if (ec) {
-		errorHandler(ec);
+		releaseConnection(m_downloader->m_request.host);
+		m_downloader->errorHandler(ec);
+		return;
 	}
-	boost::ignore_unused(bytes_transferred);
-	boost::beast::http::async_read(
-		*m_stream, 
-		m_buffer,	
-		*m_http_response_parser,
-		std::bind(
-			&LogDownloader::readHandler,
-			shared_from_this(),
-			std::placeholders::_1,
-			std::placeholders::_2,
-			it
+	m_stream = std::move(stream);
+	m_reused = reused;
+	//no operation is pending yet, everything started from here runs on m_strand
+	fillWindow();
+}
+
+void LogDownloader::Connection::fillWindow()
+{
+	if (m_closing) return;
+	while (m_in_flight.size() < m_pipeline_depth) {
+		auto it = m_downloader->popTarget();
+		if (!it) break;
+		m_in_flight.push_back(*it);
+		m_write_queue.push_back(createHttpRequest(**it));
+	}
+	if (m_in_flight.empty()) {
+		//all done, keep connection open for the next request
+		m_closing = true;
+		m_downloader->m_pool->release(m_downloader->m_request.host, m_downloader->m_request.port, std::move(m_stream));
+		releaseConnection(m_downloader->m_request.host);
+		return;
+	}
+	if (!m_writing && !m_write_queue.empty()) {
+		doWrite();
+	}
+	if (!m_reading) {
+		doRead();
+	}
+}
+
+void LogDownloader::Connection::doWrite()
+{
+	m_writing = true;
+	boost::beast::http::async_write(
+		*m_stream,
+		m_write_queue.front(),
+		boost::asio::bind_executor(
+			m_strand,
+			std::bind(
+				&Connection::writeHandler,
+				shared_from_this(),
+				std::placeholders::_1,
+				std::placeholders::_2
+			)
 		)
 	);
 }
 
-void LogDownloader::readHandler(boost::system::error_code ec, std::size_t bytes_transferred, LogRequest::TargetIterator it)
+void LogDownloader::Connection::writeHandler(boost::system::error_code ec, std::size_t bytes_transferred)
 {
+	boost::ignore_unused(bytes_transferred);
+	m_writing = false;
+	if (m_closing) return;
 	if (ec) {
-		errorHandler(ec);
+		failureHandler(ec);
+		return;
 	}
-	boost::ignore_unused(bytes_transferred);
+	m_write_queue.pop_front();
+	if (!m_write_queue.empty()) {
+		doWrite();
+	}
+}
 
-	std::lock_guard<std::mutex> lock(m_read_handler_mutex);
-	
-	std::string temp_data = std::move(m_http_response_parser->get().body());
+void LogDownloader::Connection::doRead()
+{
+	m_reading = true;
+	m_target_stream.reset();
 	m_http_response_parser.emplace();
 	m_http_response_parser->body_limit(std::numeric_limits<std::uint64_t>::max());
-	
-	auto next_it = std::next(it);
-	
-	if (next_it != m_request.targets.cend()) {
-		fillHttpRequest(*next_it);
-		boost::beast::http::async_write(
-			*m_stream,
-			m_http_request,
+	boost::beast::http::async_read_header(
+		*m_stream,
+		m_buffer,
+		*m_http_response_parser,
+		boost::asio::bind_executor(
+			m_strand,
 			std::bind(
-				&LogDownloader::writeHandler,
+				&Connection::headerHandler,
 				shared_from_this(),
 				std::placeholders::_1,
-				std::placeholders::_2,
-				next_it
+				std::placeholders::_2
 			)
-		);
+		)
+	);
+}
+
+void LogDownloader::Connection::headerHandler(boost::system::error_code ec, std::size_t bytes_transferred)
+{
+	boost::ignore_unused(bytes_transferred);
+	if (m_closing) {
+		m_reading = false;
+		return;
 	}
-	else {
-		m_stream->async_shutdown(
+	if (ec) {
+		m_reading = false;
+		failureHandler(ec);
+		return;
+	}
+
+	auto & response = m_http_response_parser->get();
+	bool cacheable = response.result() == boost::beast::http::status::ok;
+	m_target_stream = std::make_shared<TargetStream>(m_downloader, m_in_flight.front(), cacheable);
+	response.body().batch_size = m_downloader->m_request.batch_size;
+	response.body().sink = std::bind(&TargetStream::write, m_target_stream, std::placeholders::_1);
+
+	boost::beast::http::async_read(
+		*m_stream,
+		m_buffer,
+		*m_http_response_parser,
+		boost::asio::bind_executor(
+			m_strand,
 			std::bind(
-				&LogDownloader::shutdownHandler,
+				&Connection::readHandler,
 				shared_from_this(),
-				std::placeholders::_1
+				std::placeholders::_1,
+				std::placeholders::_2
 			)
-		);
+		)
+	);
+}
+
+void LogDownloader::Connection::readHandler(boost::system::error_code ec, std::size_t bytes_transferred)
+{
+	boost::ignore_unused(bytes_transferred);
+	m_reading = false;
+	if (m_closing) return;
+	if (ec) {
+		failureHandler(ec);
+		return;
 	}
-	
-	Log log(std::move(std::get<0>(*it)), std::move(std::get<1>(*it)), std::move(temp_data), m_request.parser);
 
-	m_request.callback(std::move(log));
+	m_got_response = true;
+	bool keep_alive = m_http_response_parser->get().keep_alive();
+	auto target_stream = std::move(m_target_stream);
+	m_in_flight.pop_front();
+
+	if (keep_alive) {
+		//request next targets before parsing so the connection is not idle
+		fillWindow();
+	}
+	else if (!m_in_flight.empty()) {
+		//server closes after this response, re-issue the rest one by one
+		reconnect(1);
+	}
+	else if (m_downloader->hasTargets()) {
+		reconnect(m_pipeline_depth);
+	}
+	else {
+		m_closing = true;
+		releaseConnection(m_downloader->m_request.host);
+	}
+
+	target_stream->finish();
 }
 
-void LogDownloader::shutdownHandler(boost::system::error_code ec)
+void LogDownloader::Connection::reconnect(std::size_t pipeline_depth)
 {
-	if (ec && ec.value() != boost::asio::ssl::error::stream_truncated) throw std::runtime_error(ec.message());
-	//if (ec) throw std::runtime_error(ec.message());
+	m_closing = true;
+	m_downloader->requeueTargets(m_in_flight);
+	m_in_flight.clear();
+	boost::system::error_code ignored_ec;
+	m_stream->next_layer().close(ignored_ec);
+	//connection slot is handed over to the new connection
+	std::make_shared<Connection>(m_downloader, pipeline_depth)->run();
+}
+
+void LogDownloader::Connection::failureHandler(boost::system::error_code ec)
+{
+	if (m_target_stream && !m_target_stream->isRetryable()) {
+		//lines of this target have already been passed on
+		m_closing = true;
+		releaseConnection(m_downloader->m_request.host);
+		m_downloader->errorHandler(ec);
+		return;
+	}
+	if (m_reused && !m_got_response) {
+		//idle connection was closed by server while in pool
+		reconnect(m_pipeline_depth);
+		return;
+	}
+	if (m_pipeline_depth > 1 && !m_in_flight.empty()) {
+		reconnect(1);
+		return;
+	}
+	m_closing = true;
+	releaseConnection(m_downloader->m_request.host);
+	m_downloader->errorHandler(ec);
+}
+
+LogDownloader::HttpRequestType LogDownloader::Connection::createHttpRequest(const LogRequest::Target & target)
+{
+	HttpRequestType http_request;
+	http_request.version(m_downloader->m_request.version);
+	http_request.method(boost::beast::http::verb::get);
+	http_request.target(std::get<2>(target));
+	http_request.set(boost::beast::http::field::host, m_downloader->m_request.host);
+	http_request.set(boost::beast::http::field::user_agent, BOOST_BEAST_VERSION_STRING);
+	return http_request;
+}
+
+LogDownloader::TargetStream::TargetStream(std::shared_ptr<LogDownloader> downloader, LogRequest::TargetIterator it, bool cacheable) :
+	m_downloader(std::move(downloader)),
+	m_it(it),
+	m_cacheable(cacheable),
+	m_batched(static_cast<bool>(m_downloader->m_request.batch_callback))
+{
+	auto & request = m_downloader->m_request;
+	if (m_batched && request.cache && m_cacheable) {
+		m_cache_writer = request.cache->createWriter(request.host, std::get<2>(*m_it), std::get<0>(*m_it));
+	}
+	if (m_batched && request.rollups) {
+		m_rollup_writer = request.rollups->createWriter(std::get<1>(*m_it), std::get<0>(*m_it), std::get<3>(*m_it));
+	}
+}
+
+void LogDownloader::TargetStream::write(std::string && chunk)
+{
+	m_written = true;
+	if (!m_batched) {
+		m_data.append(chunk);
+		return;
+	}
+	std::size_t index = m_batches_written++;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		++m_pending;
+	}
+	dispatch(std::bind(&TargetStream::processBatch, shared_from_this(), index, std::move(chunk)));
+}
+
+void LogDownloader::TargetStream::finish()
+{
+	if (!m_batched) {
+		dispatch([downloader = m_downloader, it = m_it, data = std::move(m_data), cacheable = m_cacheable]() mutable {
+			downloader->deliver(it, std::move(data), cacheable);
+		});
+		return;
+	}
+	if (!m_written) {
+		//empty body, parse it anyway so validity is decided by parser
+		write(std::string());
+	}
+	bool done;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_finished = true;
+		done = m_pending == 0;
+	}
+	if (done) {
+		complete();
+	}
+}
+
+void LogDownloader::TargetStream::processBatch(std::size_t index, std::string & chunk)
+{
+	Log log(TimeDetail::TimePeriod(std::get<0>(*m_it)), Log::ChannelName(std::get<1>(*m_it)), std::move(chunk), m_downloader->m_request.parser);
+	std::vector<Log> ready;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!log.isValid()) {
+			m_valid = false;
+			m_cache_writer.reset();
+			m_rollup_writer.reset();
+		}
+		if (m_rollup_writer) {
+			m_rollup_writer->append(log);
+		}
+		if (!m_cache_writer) {
+			//order only matters for the cache
+			ready.push_back(std::move(log));
+			for (auto & parsed : m_parsed) {
+				ready.push_back(std::move(parsed.second));
+			}
+			m_parsed.clear();
+		}
+		else {
+			m_parsed.emplace(index, std::move(log));
+			while (!m_parsed.empty() && m_parsed.begin()->first == m_next_append) {
+				auto node = m_parsed.extract(m_parsed.begin());
+				m_cache_writer->append(node.mapped());
+				ready.push_back(std::move(node.mapped()));
+				++m_next_append;
+			}
+		}
+	}
+	for (auto & ready_log : ready) {
+		m_downloader->m_request.batch_callback(std::move(ready_log));
+	}
+	bool done;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_pending -= ready.size();
+		done = m_finished && m_pending == 0;
+	}
+	if (done) {
+		complete();
+	}
+}
+
+void LogDownloader::TargetStream::complete()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_valid && m_cache_writer) {
+			m_cache_writer->commit();
+		}
+		if (m_valid && m_rollup_writer) {
+			m_rollup_writer->commit();
+		}
+	}
+	m_downloader->m_request.target_done_handler();
+}
+
+void LogDownloader::TargetStream::dispatch(ComputePool::TaskType task)
+{
+	if (auto pool = m_downloader->m_request.compute_pool) {
+		pool->post(std::move(task));
+	}
+	else {
+		task();
+	}
 }
 
-void LogDownloader::fillHttpRequest(const LogRequest::Target & target)
+bool LogDownloader::TargetStream::isRetryable() const
 {
-	m_http_request = HttpRequestType();
-	m_http_request.version(m_request.version);
-	m_http_request.method(boost::beast::http::verb::get);
-	m_http_request.target(std::get<2>(target));
-	m_http_request.set(boost::beast::http::field::host, m_request.host);
-	m_http_request.set(boost::beast::http::field::user_agent, BOOST_BEAST_VERSION_STRING);
+	return !m_batched || !m_written;
 }
 
 std::string createGempirUserTarget(const std::string_view & channel, const std::string_view & user, const date::year_month & ym)
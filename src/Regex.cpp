@@ -0,0 +1,726 @@
+//Regex.cpp
+
+#include "../include/Regex.hpp"
+
+struct Regex::Node
+{
+	enum class Type
+	{
+		empty,
+		bytes,
+		concat,
+		alternate,
+		repeat,
+		line_begin,
+		line_end,
+		word_boundary,
+		not_word_boundary
+	};
+
+	Node(Type type) :
+		type(type)
+	{
+	}
+
+	Type type;
+	ByteClass byte_class{};
+	//byte if node is a single literal (lower case if caseless), else -1
+	int literal = -1;
+	std::vector<std::unique_ptr<Node>> children;
+	int min = 0;
+	int max = 0; //-1 is unbounded
+	bool greedy = true;
+};
+
+/*
+Recursive descent parser producing a Node tree.
+*/
+class Regex::Parser
+{
+public:
+	static constexpr int max_depth = 128;
+
+	Parser(std::string_view pattern, bool caseless) :
+		m_pattern(pattern),
+		m_caseless(caseless)
+	{
+	}
+
+	std::unique_ptr<Node> parse()
+	{
+		auto node = parseAlternate(0);
+		if (m_pos != m_pattern.size()) {
+			fail("unmatched )");
+		}
+		return node;
+	}
+
+private:
+	[[noreturn]] void fail(const char * what)
+	{
+		throw std::runtime_error(std::string("Regex: ").append(what));
+	}
+
+	bool end() const
+	{
+		return m_pos >= m_pattern.size();
+	}
+
+	char peek() const
+	{
+		return m_pattern[m_pos];
+	}
+
+	static void addByte(ByteClass & c, unsigned char b)
+	{
+		c[b >> 6] |= std::uint64_t(1) << (b & 63);
+	}
+
+	static void addRange(ByteClass & c, unsigned char first, unsigned char last)
+	{
+		for (unsigned b = first; b <= last; ++b) {
+			addByte(c, static_cast<unsigned char>(b));
+		}
+	}
+
+	static void addNegated(ByteClass & c, const ByteClass & other)
+	{
+		for (std::size_t i = 0; i < c.size(); ++i) {
+			c[i] |= ~other[i];
+		}
+	}
+
+	void foldClass(ByteClass & c) const
+	{
+		if (!m_caseless) return;
+		for (unsigned b = 'a'; b <= 'z'; ++b) {
+			unsigned upper = b - ('a' - 'A');
+			if (classHas(c, static_cast<unsigned char>(b)) || classHas(c, static_cast<unsigned char>(upper))) {
+				addByte(c, static_cast<unsigned char>(b));
+				addByte(c, static_cast<unsigned char>(upper));
+			}
+		}
+	}
+
+	std::unique_ptr<Node> createLiteral(unsigned char b)
+	{
+		auto node = std::make_unique<Node>(Node::Type::bytes);
+		addByte(node->byte_class, b);
+		foldClass(node->byte_class);
+		node->literal = (m_caseless && b >= 'A' && b <= 'Z') ? b + ('a' - 'A') : b;
+		return node;
+	}
+
+	std::unique_ptr<Node> createClass(const ByteClass & c)
+	{
+		auto node = std::make_unique<Node>(Node::Type::bytes);
+		node->byte_class = c;
+		foldClass(node->byte_class);
+		return node;
+	}
+
+	/*
+	Class of \d \w \s, upper case letter is negated.
+	Return:
+		true if c was a class escape
+	*/
+	static bool classEscape(char c, ByteClass & out)
+	{
+		ByteClass set{};
+		switch (c) {
+		case 'd': case 'D':
+			addRange(set, '0', '9');
+			break;
+		case 'w': case 'W':
+			addRange(set, 'a', 'z');
+			addRange(set, 'A', 'Z');
+			addRange(set, '0', '9');
+			addByte(set, '_');
+			break;
+		case 's': case 'S':
+			for (char s : { ' ', '\t', '\n', '\r', '\f', '\v' }) {
+				addByte(set, static_cast<unsigned char>(s));
+			}
+			break;
+		default:
+			return false;
+		}
+		if (c >= 'A' && c <= 'Z') {
+			addNegated(out, set);
+		}
+		else {
+			for (std::size_t i = 0; i < out.size(); ++i) {
+				out[i] |= set[i];
+			}
+		}
+		return true;
+	}
+
+	unsigned hexValue(std::size_t digits)
+	{
+		unsigned value = 0;
+		for (std::size_t i = 0; i < digits; ++i) {
+			if (end()) fail("incomplete hex escape");
+			char c = m_pattern[m_pos++];
+			value <<= 4;
+			if (c >= '0' && c <= '9') value |= c - '0';
+			else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10;
+			else if (c >= 'A' && c <= 'F') value |= c - 'A' + 10;
+			else fail("invalid hex escape");
+		}
+		return value;
+	}
+
+	/*
+	Byte value of escape after '\', class and assertion escapes are handled by caller.
+	*/
+	unsigned char byteEscape(char c, bool in_class)
+	{
+		switch (c) {
+		case 'n': return '\n';
+		case 't': return '\t';
+		case 'r': return '\r';
+		case 'f': return '\f';
+		case 'v': return '\v';
+		case '0': return '\0';
+		case 'b':
+			if (in_class) return '\b';
+			break;
+		case 'x':
+			return static_cast<unsigned char>(hexValue(2));
+		case 'u': {
+			unsigned value = hexValue(4);
+			if (value > 0x7F) fail("\\u escape outside ASCII is not supported");
+			return static_cast<unsigned char>(value);
+		}
+		default:
+			break;
+		}
+		if (c >= '1' && c <= '9') fail("backreferences are not supported");
+		if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) fail("unknown escape");
+		return static_cast<unsigned char>(c);
+	}
+
+	std::unique_ptr<Node> parseAlternate(int depth)
+	{
+		if (depth > max_depth) fail("pattern nested too deeply");
+		auto first = parseConcat(depth);
+		if (end() || peek() != '|') return first;
+		auto node = std::make_unique<Node>(Node::Type::alternate);
+		node->children.push_back(std::move(first));
+		while (!end() && peek() == '|') {
+			++m_pos;
+			node->children.push_back(parseConcat(depth));
+		}
+		return node;
+	}
+
+	std::unique_ptr<Node> parseConcat(int depth)
+	{
+		auto node = std::make_unique<Node>(Node::Type::concat);
+		while (!end() && peek() != '|' && peek() != ')') {
+			auto child = parseRepeat(depth);
+			//flatten so literal prefix can be read from top level
+			if (child->type == Node::Type::concat) {
+				for (auto & grandchild : child->children) {
+					node->children.push_back(std::move(grandchild));
+				}
+			}
+			else {
+				node->children.push_back(std::move(child));
+			}
+		}
+		if (node->children.empty()) return std::make_unique<Node>(Node::Type::empty);
+		if (node->children.size() == 1) return std::move(node->children.front());
+		return node;
+	}
+
+	int parseNumber()
+	{
+		if (end() || peek() < '0' || peek() > '9') fail("invalid repeat");
+		int value = 0;
+		while (!end() && peek() >= '0' && peek() <= '9') {
+			value = value * 10 + (m_pattern[m_pos++] - '0');
+			if (value > max_repeat) fail("repeat count too large");
+		}
+		return value;
+	}
+
+	std::unique_ptr<Node> parseRepeat(int depth)
+	{
+		auto atom = parseAtom(depth);
+		if (end()) return atom;
+		int min = 0;
+		int max = 0;
+		switch (peek()) {
+		case '*':
+			min = 0;
+			max = -1;
+			++m_pos;
+			break;
+		case '+':
+			min = 1;
+			max = -1;
+			++m_pos;
+			break;
+		case '?':
+			min = 0;
+			max = 1;
+			++m_pos;
+			break;
+		case '{':
+			++m_pos;
+			min = parseNumber();
+			max = min;
+			if (!end() && peek() == ',') {
+				++m_pos;
+				max = (!end() && peek() == '}') ? -1 : parseNumber();
+			}
+			if (end() || peek() != '}') fail("invalid repeat");
+			++m_pos;
+			if (max != -1 && max < min) fail("invalid repeat range");
+			break;
+		default:
+			return atom;
+		}
+		auto node = std::make_unique<Node>(Node::Type::repeat);
+		node->min = min;
+		node->max = max;
+		if (!end() && peek() == '?') {
+			node->greedy = false;
+			++m_pos;
+		}
+		if (!end() && (peek() == '*' || peek() == '+' || peek() == '?' || peek() == '{')) {
+			fail("nothing to repeat");
+		}
+		node->children.push_back(std::move(atom));
+		return node;
+	}
+
+	std::unique_ptr<Node> parseClass()
+	{
+		ByteClass set{};
+		bool negate = false;
+		if (!end() && peek() == '^') {
+			negate = true;
+			++m_pos;
+		}
+		bool first = true;
+		while (true) {
+			if (end()) fail("unmatched [");
+			char c = m_pattern[m_pos++];
+			if (c == ']' && !first) break;
+			first = false;
+			unsigned char low;
+			if (c == '\\') {
+				if (end()) fail("trailing \\");
+				char e = m_pattern[m_pos++];
+				if (classEscape(e, set)) continue;
+				low = byteEscape(e, true);
+			}
+			else {
+				low = static_cast<unsigned char>(c);
+			}
+			if (m_pos + 1 < m_pattern.size() && peek() == '-' && m_pattern[m_pos + 1] != ']') {
+				++m_pos;
+				char h = m_pattern[m_pos++];
+				unsigned char high;
+				if (h == '\\') {
+					if (end()) fail("trailing \\");
+					high = byteEscape(m_pattern[m_pos++], true);
+				}
+				else {
+					high = static_cast<unsigned char>(h);
+				}
+				if (high < low) fail("invalid class range");
+				addRange(set, low, high);
+			}
+			else {
+				addByte(set, low);
+			}
+		}
+		foldClass(set);
+		if (negate) {
+			ByteClass negated{};
+			addNegated(negated, set);
+			set = negated;
+		}
+		auto node = std::make_unique<Node>(Node::Type::bytes);
+		node->byte_class = set;
+		return node;
+	}
+
+	std::unique_ptr<Node> parseAtom(int depth)
+	{
+		char c = m_pattern[m_pos++];
+		switch (c) {
+		case '(': {
+			if (!end() && peek() == '?') {
+				if (m_pos + 1 < m_pattern.size() && m_pattern[m_pos + 1] == ':') {
+					m_pos += 2;
+				}
+				else {
+					fail("lookaround is not supported");
+				}
+			}
+			auto node = parseAlternate(depth + 1);
+			if (end() || peek() != ')') fail("unmatched (");
+			++m_pos;
+			return node;
+		}
+		case '[':
+			return parseClass();
+		case '.': {
+			ByteClass set{};
+			ByteClass newline{};
+			addByte(newline, '\n');
+			addByte(newline, '\r');
+			addNegated(set, newline);
+			return createClass(set);
+		}
+		case '^':
+			return std::make_unique<Node>(Node::Type::line_begin);
+		case '$':
+			return std::make_unique<Node>(Node::Type::line_end);
+		case '\\': {
+			if (end()) fail("trailing \\");
+			char e = m_pattern[m_pos++];
+			if (e == 'b') return std::make_unique<Node>(Node::Type::word_boundary);
+			if (e == 'B') return std::make_unique<Node>(Node::Type::not_word_boundary);
+			ByteClass set{};
+			if (classEscape(e, set)) return createClass(set);
+			return createLiteral(byteEscape(e, false));
+		}
+		case '*': case '+': case '?': case '{':
+			fail("nothing to repeat");
+		case ')':
+			fail("unmatched )");
+		default:
+			return createLiteral(static_cast<unsigned char>(c));
+		}
+	}
+
+	std::string_view m_pattern;
+	std::size_t m_pos = 0;
+	bool m_caseless;
+};
+
+namespace
+{
+	struct Thread
+	{
+		std::uint32_t pc;
+		std::size_t start;
+	};
+
+	/*
+	Per thread VM state, reused between searches.
+	Marks are compared against a generation that only grows so they never need clearing.
+	*/
+	struct Scratch
+	{
+		std::vector<std::uint64_t> marks;
+		std::uint64_t generation = 0;
+		std::vector<Thread> clist;
+		std::vector<Thread> nlist;
+		std::vector<std::uint32_t> stack;
+	};
+
+	thread_local Scratch scratch;
+
+	struct CacheEntry
+	{
+		std::string key;
+		std::shared_ptr<const Regex> regex;
+	};
+
+	constexpr std::size_t cache_size = 64;
+	std::mutex cache_mutex;
+	std::list<CacheEntry> cache_lru; //front is most recently used
+	std::unordered_map<std::string, std::list<CacheEntry>::iterator> cache_map;
+}
+
+bool Regex::collectLiteralPrefix(const Node & node, std::string & prefix)
+{
+	if (node.literal >= 0) {
+		prefix.push_back(static_cast<char>(node.literal));
+		return true;
+	}
+	if (node.type == Node::Type::concat) {
+		for (auto & child : node.children) {
+			if (!collectLiteralPrefix(*child, prefix)) return false;
+		}
+		return true;
+	}
+	return node.type == Node::Type::empty;
+}
+
+Regex::Regex(std::string_view pattern, bool caseless)
+{
+	if (pattern.size() > max_pattern_size) {
+		throw std::runtime_error("Regex: pattern too long");
+	}
+	auto root = Parser(pattern, caseless).parse();
+
+	std::string prefix;
+	m_literal = collectLiteralPrefix(*root, prefix);
+	if (m_literal || !prefix.empty()) {
+		m_literal_size = prefix.size();
+		m_prefix_searcher.emplace(prefix, caseless);
+	}
+	if (!m_literal) {
+		compileNode(*root);
+		emit(Op::match);
+	}
+}
+
+std::shared_ptr<const Regex> Regex::compile(std::string_view pattern, bool caseless)
+{
+	std::string key;
+	key.push_back(caseless ? 'i' : '-');
+	key.append(pattern);
+	{
+		std::lock_guard<std::mutex> lock(cache_mutex);
+		auto it = cache_map.find(key);
+		if (it != cache_map.end()) {
+			cache_lru.splice(cache_lru.begin(), cache_lru, it->second);
+			return it->second->regex;
+		}
+	}
+	//compile outside lock, pattern errors propagate to caller
+	auto regex = std::make_shared<const Regex>(pattern, caseless);
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	if (cache_map.find(key) == cache_map.end()) {
+		cache_lru.push_front(CacheEntry{ key, regex });
+		cache_map.emplace(std::move(key), cache_lru.begin());
+		if (cache_lru.size() > cache_size) {
+			cache_map.erase(cache_lru.back().key);
+			cache_lru.pop_back();
+		}
+	}
+	return regex;
+}
+
+std::optional<Regex::Match> Regex::search(std::string_view str, std::size_t pos) const
+{
+	if (pos > str.size()) return std::nullopt;
+	if (m_literal) {
+		std::size_t p = m_prefix_searcher->find(str, pos);
+		if (p == SubstringSearcher::npos) return std::nullopt;
+		return Match(p, p + m_literal_size);
+	}
+	return run(str, pos, false, false);
+}
+
+bool Regex::fullMatch(std::string_view str) const
+{
+	if (m_literal) {
+		return str.size() == m_literal_size && m_prefix_searcher->find(str) == 0;
+	}
+	return run(str, 0, true, true).has_value();
+}
+
+std::size_t Regex::count(std::string_view str) const
+{
+	std::size_t count = 0;
+	std::size_t pos = 0;
+	while (auto m = search(str, pos)) {
+		++count;
+		pos = m->second > m->first ? m->second : m->second + 1;
+	}
+	return count;
+}
+
+bool Regex::isWordByte(unsigned char b)
+{
+	return (b >= 'a' && b <= 'z') || (b >= 'A' && b <= 'Z') || (b >= '0' && b <= '9') || b == '_';
+}
+
+void Regex::compileNode(const Node & node)
+{
+	if (++m_compile_work > max_compile_work) {
+		throw std::runtime_error("Regex: pattern too large");
+	}
+	switch (node.type) {
+	case Node::Type::empty:
+		break;
+	case Node::Type::bytes:
+		emit(Op::byte_class, addClass(node.byte_class));
+		break;
+	case Node::Type::concat:
+		for (auto & child : node.children) {
+			compileNode(*child);
+		}
+		break;
+	case Node::Type::alternate: {
+		std::vector<std::uint32_t> jumps;
+		for (std::size_t i = 0; i + 1 < node.children.size(); ++i) {
+			std::uint32_t split = emit(Op::split);
+			m_program[split].x = split + 1;
+			compileNode(*node.children[i]);
+			jumps.push_back(emit(Op::jump));
+			m_program[split].y = static_cast<std::uint32_t>(m_program.size());
+		}
+		compileNode(*node.children.back());
+		for (auto j : jumps) {
+			m_program[j].x = static_cast<std::uint32_t>(m_program.size());
+		}
+		break;
+	}
+	case Node::Type::repeat: {
+		const Node & child = *node.children.front();
+		for (int i = 0; i < node.min; ++i) {
+			compileNode(child);
+		}
+		if (node.max == -1) {
+			std::uint32_t split = emit(Op::split);
+			compileNode(child);
+			emit(Op::jump, split);
+			std::uint32_t body = split + 1;
+			std::uint32_t out = static_cast<std::uint32_t>(m_program.size());
+			m_program[split].x = node.greedy ? body : out;
+			m_program[split].y = node.greedy ? out : body;
+		}
+		else {
+			std::vector<std::uint32_t> splits;
+			for (int i = node.min; i < node.max; ++i) {
+				splits.push_back(emit(Op::split));
+				compileNode(child);
+			}
+			std::uint32_t out = static_cast<std::uint32_t>(m_program.size());
+			for (auto split : splits) {
+				m_program[split].x = node.greedy ? split + 1 : out;
+				m_program[split].y = node.greedy ? out : split + 1;
+			}
+		}
+		break;
+	}
+	case Node::Type::line_begin:
+		emit(Op::line_begin);
+		break;
+	case Node::Type::line_end:
+		emit(Op::line_end);
+		break;
+	case Node::Type::word_boundary:
+		emit(Op::word_boundary);
+		break;
+	case Node::Type::not_word_boundary:
+		emit(Op::not_word_boundary);
+		break;
+	}
+}
+
+std::uint32_t Regex::emit(Op op, std::uint32_t x, std::uint32_t y)
+{
+	if (m_program.size() >= max_program_size) {
+		throw std::runtime_error("Regex: pattern too large");
+	}
+	m_program.push_back(Inst{ op, x, y });
+	return static_cast<std::uint32_t>(m_program.size() - 1);
+}
+
+std::uint32_t Regex::addClass(const ByteClass & c)
+{
+	for (std::size_t i = 0; i < m_classes.size(); ++i) {
+		if (m_classes[i] == c) return static_cast<std::uint32_t>(i);
+	}
+	m_classes.push_back(c);
+	return static_cast<std::uint32_t>(m_classes.size() - 1);
+}
+
+std::optional<Regex::Match> Regex::run(std::string_view str, std::size_t pos, bool anchored, bool full) const
+{
+	const std::size_t n = str.size();
+	if (scratch.marks.size() < m_program.size()) {
+		scratch.marks.resize(m_program.size(), 0);
+	}
+	auto & marks = scratch.marks;
+	auto & stack = scratch.stack;
+	auto & clist = scratch.clist;
+	auto & nlist = scratch.nlist;
+
+	//follow jumps, splits and assertions at position i, in priority order
+	auto add_thread = [&](std::vector<Thread> & list, std::uint64_t generation, std::uint32_t pc, std::size_t start, std::size_t i) {
+		stack.clear();
+		stack.push_back(pc);
+		while (!stack.empty()) {
+			std::uint32_t p = stack.back();
+			stack.pop_back();
+			if (marks[p] == generation) continue;
+			marks[p] = generation;
+			const Inst & inst = m_program[p];
+			switch (inst.op) {
+			case Op::jump:
+				stack.push_back(inst.x);
+				break;
+			case Op::split:
+				stack.push_back(inst.y);
+				stack.push_back(inst.x);
+				break;
+			case Op::line_begin:
+				if (i == 0) stack.push_back(p + 1);
+				break;
+			case Op::line_end:
+				if (i == n) stack.push_back(p + 1);
+				break;
+			case Op::word_boundary:
+			case Op::not_word_boundary: {
+				bool before = i > 0 && isWordByte(static_cast<unsigned char>(str[i - 1]));
+				bool after = i < n && isWordByte(static_cast<unsigned char>(str[i]));
+				if ((before != after) == (inst.op == Op::word_boundary)) stack.push_back(p + 1);
+				break;
+			}
+			case Op::byte_class:
+			case Op::match:
+				list.push_back(Thread{ p, start });
+				break;
+			}
+		}
+	};
+
+	std::optional<Match> result;
+	std::size_t i = pos;
+	if (!anchored && m_prefix_searcher) {
+		i = m_prefix_searcher->find(str, i);
+		if (i == SubstringSearcher::npos) return std::nullopt;
+	}
+	clist.clear();
+	std::uint64_t clist_generation = ++scratch.generation;
+	add_thread(clist, clist_generation, 0, i, i);
+
+	while (true) {
+		nlist.clear();
+		std::uint64_t nlist_generation = ++scratch.generation;
+		for (std::size_t k = 0; k < clist.size(); ++k) {
+			const Thread t = clist[k];
+			const Inst & inst = m_program[t.pc];
+			if (inst.op == Op::match) {
+				if (!full || i == n) {
+					result = Match(t.start, i);
+					//threads after this one have lower priority
+					break;
+				}
+				continue;
+			}
+			if (i < n && classHas(m_classes[inst.x], static_cast<unsigned char>(str[i]))) {
+				add_thread(nlist, nlist_generation, t.pc + 1, t.start, i + 1);
+			}
+		}
+		if (i >= n) break;
+		++i;
+		std::swap(clist, nlist);
+		clist_generation = nlist_generation;
+		if (!anchored && !result) {
+			if (clist.empty() && m_prefix_searcher) {
+				i = m_prefix_searcher->find(str, i);
+				if (i == SubstringSearcher::npos) break;
+				clist_generation = ++scratch.generation;
+			}
+			add_thread(clist, clist_generation, 0, i, i);
+		}
+		else if (clist.empty()) {
+			break;
+		}
+	}
+	return result;
+}
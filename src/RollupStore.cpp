@@ -0,0 +1,268 @@
+//RollupStore.cpp
+
+#include "../include/RollupStore.hpp"
+
+RollupStore::RollupStore(std::size_t max_tokens, Duration retention, Duration log_delay) :
+	m_max_tokens(max_tokens),
+	m_retention(retention),
+	m_log_delay(log_delay)
+{
+}
+
+std::unique_ptr<RollupStore::Writer> RollupStore::createWriter(std::string_view channel, const TimeDetail::TimePeriod & period, std::string_view user)
+{
+	//whole hours so the cutoff lines up with the live buckets
+	TimeDetail::TimePoint cutoff = std::chrono::floor<std::chrono::hours>(std::chrono::system_clock::now() - m_log_delay);
+	return std::unique_ptr<Writer>(new Writer(
+		*this,
+		normalizeName(channel),
+		normalizeName(user),
+		period.begin(),
+		std::min(period.end(), cutoff)
+	));
+}
+
+void RollupStore::addLive(std::string_view channel, std::string_view user, TimeDetail::TimePoint time, std::string_view message)
+{
+	std::string user_key = normalizeName(user);
+	Record record;
+	std::string scratch;
+	record.add(message, scratch);
+
+	Channel & store_channel = getChannel(normalizeName(channel));
+	std::lock_guard<std::mutex> lock(store_channel.mutex);
+	if (!store_channel.live_since || time < *store_channel.live_since) return;
+	prune(store_channel, time);
+
+	UserDay & user_day = getUserDay(store_channel.days[std::chrono::floor<date::days>(time)], user_key);
+	if (time < user_day.base_until) return;
+	user_day.live[std::chrono::floor<std::chrono::hours>(time)].merge(std::move(record));
+}
+
+void RollupStore::setLiveSince(std::string_view channel, TimeDetail::TimePoint time)
+{
+	Channel & store_channel = getChannel(normalizeName(channel));
+	std::lock_guard<std::mutex> lock(store_channel.mutex);
+	store_channel.live_since = time;
+}
+
+void RollupStore::clearLive(std::string_view channel)
+{
+	Channel & store_channel = getChannel(normalizeName(channel));
+	std::lock_guard<std::mutex> lock(store_channel.mutex);
+	store_channel.live_since.reset();
+}
+
+void RollupStore::clearLive()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (auto & pair : m_channels) {
+		std::lock_guard<std::mutex> channel_lock(pair.second->mutex);
+		pair.second->live_since.reset();
+	}
+}
+
+std::optional<std::uint64_t> RollupStore::countToken(std::string_view channel, std::string_view user, const TimeDetail::TimePeriod & period, std::string_view token)
+{
+	TimeDetail::TimePoint now = std::chrono::system_clock::now();
+	date::sys_days first = std::chrono::floor<date::days>(period.begin());
+	if (TimeDetail::TimePoint(first) != period.begin()) return std::nullopt;
+	if (period.end() < now && TimeDetail::TimePoint(std::chrono::floor<date::days>(period.end())) != period.end()) return std::nullopt;
+	TimeDetail::TimePoint last = std::min(period.end(), now);
+
+	std::string user_key = normalizeName(user);
+	std::string token_key;
+	TokenIndex::lowerToken(token, token_key);
+
+	Channel & store_channel = getChannel(normalizeName(channel));
+	std::lock_guard<std::mutex> lock(store_channel.mutex);
+	const std::optional<TimeDetail::TimePoint> & live_since = store_channel.live_since;
+
+	std::uint64_t count = 0;
+	for (date::sys_days day = first; TimeDetail::TimePoint(day) < last; day += date::days(1)) {
+		TimeDetail::TimePoint base_until;
+		const UserDay * user_day = nullptr;
+		auto day_it = store_channel.days.find(day);
+		if (day_it != store_channel.days.end()) {
+			base_until = day_it->second.base_until;
+			auto user_it = day_it->second.users.find(user_key);
+			if (user_it != day_it->second.users.end()) {
+				user_day = &user_it->second;
+				base_until = user_day->base_until;
+			}
+		}
+
+		//lines after base_until are only known if live tracking has no gap
+		bool covered = TimeDetail::TimePoint(day + date::days(1)) <= base_until ||
+			(live_since && *live_since <= std::max(base_until, TimeDetail::TimePoint(day)));
+		if (!covered) return std::nullopt;
+
+		if (user_day) {
+			auto base_count = user_day->base.count(token_key);
+			if (!base_count) return std::nullopt;
+			count += *base_count;
+			for (auto & pair : user_day->live) {
+				auto live_count = pair.second.count(token_key);
+				if (!live_count) return std::nullopt;
+				count += *live_count;
+			}
+		}
+	}
+	return count;
+}
+
+std::string RollupStore::normalizeName(std::string_view name)
+{
+	if (!name.empty() && name.front() == '#') {
+		name.remove_prefix(1);
+	}
+	std::string str;
+	TokenIndex::lowerToken(name, str);
+	return str;
+}
+
+RollupStore::Channel & RollupStore::getChannel(const std::string & channel)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto & entry = m_channels[channel];
+	if (!entry) {
+		entry = std::make_unique<Channel>();
+	}
+	return *entry;
+}
+
+RollupStore::UserDay & RollupStore::getUserDay(Day & day, const std::string & user)
+{
+	auto pair = day.users.try_emplace(user);
+	if (pair.second) {
+		pair.first->second.base_until = day.base_until;
+	}
+	return pair.first->second;
+}
+
+void RollupStore::replaceBase(UserDay & user_day, Record && record, TimeDetail::TimePoint cutoff)
+{
+	//a newer download may have committed first
+	if (cutoff <= user_day.base_until) return;
+	user_day.base = std::move(record);
+	user_day.base_until = cutoff;
+	user_day.live.erase(user_day.live.begin(), user_day.live.lower_bound(cutoff));
+}
+
+void RollupStore::prune(Channel & channel, TimeDetail::TimePoint now)
+{
+	date::sys_days oldest = std::chrono::floor<date::days>(now - m_retention);
+	channel.days.erase(channel.days.begin(), channel.days.lower_bound(oldest));
+}
+
+void RollupStore::Record::add(std::string_view message, std::string & scratch)
+{
+	++lines;
+	TokenIndex::forEachToken(message, [&](std::string_view token) {
+		TokenIndex::lowerToken(token, scratch);
+		++tokens[scratch];
+	});
+}
+
+void RollupStore::Record::trim(std::size_t max_tokens)
+{
+	if (tokens.size() <= max_tokens) return;
+	std::vector<std::pair<std::string, std::uint64_t>> sorted(
+		std::make_move_iterator(tokens.begin()),
+		std::make_move_iterator(tokens.end())
+	);
+	std::nth_element(
+		sorted.begin(),
+		sorted.begin() + max_tokens,
+		sorted.end(),
+		[](auto & a, auto & b) {return a.second > b.second; }
+	);
+	sorted.resize(max_tokens);
+	tokens = std::unordered_map<std::string, std::uint64_t>(
+		std::make_move_iterator(sorted.begin()),
+		std::make_move_iterator(sorted.end())
+	);
+	truncated = true;
+}
+
+void RollupStore::Record::merge(Record && other)
+{
+	lines += other.lines;
+	if (tokens.empty()) {
+		tokens = std::move(other.tokens);
+	}
+	else {
+		for (auto & pair : other.tokens) {
+			tokens[pair.first] += pair.second;
+		}
+	}
+	truncated = truncated || other.truncated;
+}
+
+std::optional<std::uint64_t> RollupStore::Record::count(const std::string & token) const
+{
+	auto it = tokens.find(token);
+	if (it != tokens.end()) return it->second;
+	if (truncated) return std::nullopt;
+	return 0;
+}
+
+RollupStore::Writer::Writer(RollupStore & store, std::string && channel, std::string && user, TimeDetail::TimePoint begin, TimeDetail::TimePoint until) :
+	m_store(store),
+	m_channel(std::move(channel)),
+	m_user(std::move(user)),
+	m_begin(begin),
+	m_until(until)
+{
+}
+
+void RollupStore::Writer::append(const Log & log)
+{
+	const std::size_t line_count = log.getNumberOfLines();
+	for (std::size_t i = 0; i < line_count; ++i) {
+		TimeDetail::TimePoint time = log.getTime(i);
+		if (time < m_begin || time >= m_until) continue;
+		auto & users = m_days[std::chrono::floor<date::days>(time)];
+		//every line of a user log belongs to its owner
+		if (m_user.empty()) {
+			TokenIndex::lowerToken(log.getName(i), m_name);
+		}
+		Record & record = users[m_user.empty() ? m_name : m_user];
+		record.add(log.getMessage(i), m_token);
+	}
+}
+
+void RollupStore::Writer::commit()
+{
+	TimeDetail::TimePoint now = std::chrono::system_clock::now();
+	date::sys_days oldest = std::chrono::floor<date::days>(now - m_store.m_retention);
+	Channel & store_channel = m_store.getChannel(m_channel);
+	std::lock_guard<std::mutex> lock(store_channel.mutex);
+	m_store.prune(store_channel, now);
+
+	for (date::sys_days day = std::max(std::chrono::floor<date::days>(m_begin), oldest); TimeDetail::TimePoint(day) < m_until; day += date::days(1)) {
+		TimeDetail::TimePoint until = std::min(TimeDetail::TimePoint(day + date::days(1)), m_until);
+		Day & store_day = store_channel.days[day];
+		auto & users = m_days[day];
+		for (auto & pair : users) {
+			pair.second.trim(m_store.m_max_tokens);
+		}
+
+		if (m_user.empty()) {
+			//users that did not write this day had no lines
+			for (auto & pair : store_day.users) {
+				if (users.find(pair.first) == users.end()) {
+					replaceBase(pair.second, Record(), until);
+				}
+			}
+			for (auto & pair : users) {
+				replaceBase(getUserDay(store_day, pair.first), std::move(pair.second), until);
+			}
+			store_day.base_until = std::max(store_day.base_until, until);
+		}
+		else {
+			replaceBase(getUserDay(store_day, m_user), std::move(users[m_user]), until);
+		}
+	}
+	m_days.clear();
+}
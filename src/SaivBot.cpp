@@ -11,9 +11,25 @@ SaivBot::SaivBot(boost::asio::io_context & ioc, boost::asio::ssl::context && ctx
 	m_config_path(config_path),
 	m_read_strand(ioc),
 	m_send_strand(ioc),
-	m_send_message_timer(ioc)
+	m_send_message_timer(ioc),
+	m_framer(m_buffer_size)
 {
 	loadConfig(m_config_path);
+	m_log_cache = std::make_shared<LogCache>(
+		m_config_path.parent_path() / "LogCache",
+		m_log_cache_max_size,
+		m_log_cache_ttl,
+		m_log_cache_token_index
+	);
+	m_connection_pool = std::make_shared<ConnectionPool>(m_ioc);
+	m_compute_pool = std::make_unique<ComputePool>();
+	m_rollup_store = std::make_shared<RollupStore>();
+	if (m_chat_archive) {
+		m_chat_archiver = std::make_shared<ChatArchiver>(
+			m_config_path.parent_path() / "ChatArchive",
+			date::days(m_chat_archive_retention_days)
+		);
+	}
 }
 
 void SaivBot::loadConfig(const std::filesystem::path & path)
@@ -31,12 +47,23 @@ void SaivBot::loadConfig(const std::filesystem::path & path)
 	m_host = j["host"];
 	m_port = j["port"];
 	m_nick = j["nick"];
+	m_nick_lower = toLowerCaseString(m_nick);
 	m_password = j["password"];
 	nlohmann::from_json(j["modlist"], m_modlist);
 	nlohmann::from_json(j["whitelist"], m_whitelist);
+	//optional, older configs do not have it
+	if (j.contains("log_pipeline_depth")) {
+		m_log_pipeline_depth = std::max<std::size_t>(j["log_pipeline_depth"].get<std::size_t>(), 1);
+	}
+	if (j.contains("chat_archive")) {
+		m_chat_archive = j["chat_archive"].get<bool>();
+	}
+	if (j.contains("chat_archive_retention_days")) {
+		m_chat_archive_retention_days = std::max<int>(j["chat_archive_retention_days"].get<int>(), 1);
+	}
 	
 	for (const std::string & ch : j["channels"]) {
-		m_channels.try_emplace(ch, ChannelData(std::make_unique<IRCMessageBuffer>(m_message_buffer_size))); 
+		m_channels.try_emplace(ch, std::make_shared<ChannelShard>(m_ioc, m_message_buffer_size));
 	}
 }
 
@@ -49,6 +76,9 @@ void SaivBot::saveConfig(const std::filesystem::path & path)
 	j["password"] = m_password;
 	j["modlist"] = m_modlist;
 	j["whitelist"] = m_whitelist;
+	j["log_pipeline_depth"] = m_log_pipeline_depth;
+	j["chat_archive"] = m_chat_archive;
+	j["chat_archive_retention_days"] = m_chat_archive_retention_days;
 
 	{
 		std::vector<std::string_view> temp;
@@ -145,7 +175,7 @@ void SaivBot::onHandshake(boost::system::error_code ec)
 	m_time_started = std::chrono::system_clock::now();
 
 	m_stream.async_read_some(
-		boost::asio::buffer(m_recv_buffer),
+		m_framer.prepare(),
 		boost::asio::bind_executor(
 			m_read_strand,
 			std::bind(
@@ -164,13 +194,13 @@ void SaivBot::onRead(boost::system::error_code ec, std::size_t bytes_transferred
 		throw std::runtime_error(ec.message());
 	}
 
-	m_buffer.append(m_recv_buffer.data(), bytes_transferred);
+	m_framer.commit(bytes_transferred);
 	parseBuffer();
 	consumeMsgBuffer();
 
 	if (!m_suspend_read) {
 		m_stream.async_read_some(
-			boost::asio::buffer(m_recv_buffer),
+			m_framer.prepare(),
 			boost::asio::bind_executor(
 				m_read_strand,
 				std::bind(
@@ -285,14 +315,16 @@ void SaivBot::onSendQueue(boost::beast::error_code ec, std::size_t bytes_transfe
 
 void SaivBot::parseBuffer()
 {
-	const std::string cr("\r\n");
-	while (true) {
-		std::size_t n = m_buffer.find_first_of(cr);
-		if (n == m_buffer.npos) return;
-		std::string line = m_buffer.substr(0, n);
-		m_buffer.erase(m_buffer.begin(), m_buffer.begin() + n + cr.size());
-		m_msg_pre_buffer.emplace_back(std::chrono::system_clock::now(), std::move(line));
+	m_framed_lines.clear();
+	while (auto line = m_framer.nextLine()) {
+		if (!line->empty()) {
+			m_framed_lines.push_back(*line);
+		}
 	}
+	if (!m_framed_lines.empty()) {
+		IRCMessage::parseBatch(std::chrono::system_clock::now(), m_framed_lines, m_msg_pre_buffer);
+	}
+	m_framer.compact();
 }
 
 
@@ -300,37 +332,23 @@ void SaivBot::consumeMsgBuffer()
 {
 	while (!m_msg_pre_buffer.empty()) {
 		auto & irc_msg = m_msg_pre_buffer.front();
-		if (irc_msg.getCommand() == "PRIVMSG") {
-			parseFreeMessage(irc_msg);
-			//commands
-			{
-				std::string_view local_view = irc_msg.getBody();
-				
-				if (auto first_word = OptionParser::extractFirstWordDestructive(local_view)) {
-					if (caselessCompare(*first_word, m_nick)) {
-						auto pair = OptionParser::extractFirstWord(local_view);
-						if (!pair.first.empty()) {
-							std::string_view second_word = pair.first;
-							auto command_it = std::find_if(
-								m_command_containers.begin(),
-								m_command_containers.end(),
-								[&](auto & cc) {return caselessCompare(cc.m_command, second_word); }
-							);
-							if (command_it != m_command_containers.end()) {
-								command_it->m_func(irc_msg, local_view);
-							}			
-						}
-					}
+		if (irc_msg.getCommand() == "PRIVMSG" && !irc_msg.getParams().empty()) {
+			std::string channel(irc_msg.getParams()[0]);
+			auto it = m_channels.find(channel);
+			if (it != m_channels.end()) {
+				auto batch_it = std::find_if(
+					m_shard_batches.begin(),
+					m_shard_batches.end(),
+					[&](auto & pair) {return pair.first == it->second; }
+				);
+				if (batch_it == m_shard_batches.end()) {
+					batch_it = m_shard_batches.emplace(m_shard_batches.end(), it->second, std::vector<IRCMessage>());
 				}
+				batch_it->second.push_back(std::move(irc_msg));
 			}
-			{
-				std::string channel(irc_msg.getParams()[0]);
-				auto it = m_channels.find(channel);
-				if (it != m_channels.end()) {
-					std::get<0>(it->second)->push(std::move(irc_msg));
-				}
+			else {
+				handlePRIVMSG(irc_msg);
 			}
-	
 		}
 		/*
 		else if (irc_msg.getCommand() == "WHISPER") {
@@ -369,19 +387,19 @@ void SaivBot::consumeMsgBuffer()
 			else if (caselessCompare(irc_msg.getNick(), m_nick)) {
 				if (irc_msg.getCommand() == "JOIN") {
 					std::string channel(irc_msg.getParams()[0]);
+					m_rollup_store->setLiveSince(channel, irc_msg.getTime());
 					auto it = m_channels.find(channel);
 					if (it == m_channels.end()) {
 						m_channels.emplace(
 							channel,
-							ChannelData(
-								std::make_unique<IRCMessageBuffer>(m_message_buffer_size)
-							)
+							std::make_shared<ChannelShard>(m_ioc, m_message_buffer_size)
 						);
 						saveConfig(m_config_path);
 					}	
 				}
 				else if (irc_msg.getCommand() == "PART") {
 					std::string channel(irc_msg.getParams()[0]);
+					m_rollup_store->clearLive(channel);
 					auto it = m_channels.find(channel);
 					if (it != m_channels.end()) {
 						m_channels.erase(it);
@@ -393,6 +411,58 @@ void SaivBot::consumeMsgBuffer()
 		}
 		m_msg_pre_buffer.pop_front(); //POP!!!
 	}
+	postShardBatches();
+}
+
+void SaivBot::postShardBatches()
+{
+	for (auto & pair : m_shard_batches) {
+		auto shard_handler = [shard = pair.first, batch = std::move(pair.second), this]() mutable {
+			ChatArchiver::Lines lines;
+			for (auto & irc_msg : batch) {
+				handlePRIVMSG(irc_msg);
+				shard->m_buffer.push(irc_msg);
+				m_rollup_store->addLive(irc_msg.getParams()[0], irc_msg.getNick(), irc_msg.getTime(), irc_msg.getBody());
+				if (m_chat_archiver) {
+					lines.add(irc_msg.getParams()[0], irc_msg.getTime(), irc_msg.getNick(), irc_msg.getBody());
+				}
+			}
+			//one hand over per batch, formatted without the archiver lock
+			if (m_chat_archiver) {
+				m_chat_archiver->append(std::move(lines));
+			}
+		};
+		auto & strand = pair.first->m_strand;
+		boost::asio::post(
+			m_ioc,
+			boost::asio::bind_executor(
+				strand,
+				std::move(shard_handler)
+			)
+		);
+	}
+	m_shard_batches.clear();
+}
+
+void SaivBot::handlePRIVMSG(const IRCMessage & msg)
+{
+	parseFreeMessage(msg);
+	if (auto local_view = stripNickPrefix(msg.getBody())) {
+		std::string_view second_word = local_view->substr(0, local_view->find(' '));
+		if (auto command = findCommand(second_word)) {
+			//local_view points into storage shared by the copy of msg
+			auto command_handler = [command, msg, local_view = *local_view]() {
+				command->m_func(msg, local_view);
+			};
+			boost::asio::post(
+				m_ioc,
+				boost::asio::bind_executor(
+					m_read_strand,
+					command_handler
+				)
+			);
+		}
+	}
 }
 
 void SaivBot::parseFreeMessage(const IRCMessage & msg)
@@ -470,6 +540,8 @@ void SaivBot::postDoRECONNECT()
 	};
 
 	m_suspend_read = true;
+	//lines are missed until channels are joined again
+	m_rollup_store->clearLive();
 
 	boost::asio::post(
 		m_ioc,
@@ -501,6 +573,34 @@ void SaivBot::sendWHISPER(std::string_view target, std::string_view msg)
 	std::cout << ss.str() << "\n";
 }
 
+const CommandContainer * SaivBot::findCommand(std::string_view name) const
+{
+	std::size_t i = m_command_hash.find(name);
+	if (i == m_command_hash.npos) {
+		return nullptr;
+	}
+	return &m_command_containers[i];
+}
+
+std::optional<std::string_view> SaivBot::stripNickPrefix(std::string_view body) const
+{
+	std::size_t begin = body.find_first_not_of(' ');
+	if (begin == body.npos) return std::nullopt;
+	body.remove_prefix(begin);
+	const std::size_t nick_size = m_nick_lower.size();
+	if (body.size() <= nick_size || body[nick_size] != ' ') return std::nullopt;
+	//separator check above rejects nearly every line not addressed to bot
+	for (std::size_t i = 0; i < nick_size; ++i) {
+		if (static_cast<char>(std::tolower(static_cast<unsigned char>(body[i]))) != m_nick_lower[i]) {
+			return std::nullopt;
+		}
+	}
+	body.remove_prefix(nick_size);
+	body.remove_prefix(std::min(body.find_first_not_of(' '), body.size()));
+	if (body.empty()) return std::nullopt;
+	return body;
+}
+
 bool SaivBot::isModerator(std::string_view user)
 {
 	std::string str;
@@ -536,9 +636,7 @@ void SaivBot::helpCommandFunc(const IRCMessage & msg, std::string_view input_lin
 
 			auto command = r->get<0>();
 
-			auto it = std::find_if(m_command_containers.begin(), m_command_containers.end(), [&](auto & con) {return caselessCompare(con.m_command, command); });
-			
-			if (it != m_command_containers.end()) {
+			if (auto it = findCommand(command)) {
 				std::stringstream reply;
 				reply << msg.getNick() << ", " << it->m_description << " Usage: " << it->m_command << " " << it->m_arguments;
 				sendPRIVMSG(msg.getParams()[0], reply.str());
@@ -552,6 +650,7 @@ void SaivBot::countCommandFunc(const IRCMessage & msg, std::string_view input_li
 	if (isWhitelisted(msg.getNick())) {
 		using namespace OptionParser;
 		Parser parser(
+			Option<ListType>(m_command_containers[Commands::count_command].m_command),
 			Option<StringType>(m_command_containers[Commands::count_command].m_command),
 			Option<WordType>(m_command_containers[Commands::count_command].m_command),
 			Option<ListType>("-channel"),
@@ -562,27 +661,32 @@ void SaivBot::countCommandFunc(const IRCMessage & msg, std::string_view input_li
 			Option<WordType, WordType>("-period"),
 			Option<>("-caseless"),
 			Option<WordType>("-service"),
-			Option<>("-regex")
+			Option<>("-regex"),
+			Option<>("-word")
 		);
 
 		auto set = parser.parse(input_line);
 
-		std::string search_str;
-		if (auto result = set.find<0>()) { //target string
-			search_str = result->get<0>();
+		std::vector<std::string> search_strs;
+		if (auto result = set.find<0>()) { //target list
+			auto list = result->get<0>();
+			search_strs.assign(list.begin(), list.end());
 		}
-		else if (auto result = set.find<1>()) { //target word
-			search_str = result->get<0>();
+		else if (auto result = set.find<1>()) { //target string
+			search_strs = { std::string(result->get<0>()) };
 		}
-		else {
+		else if (auto result = set.find<2>()) { //target word
+			search_strs = { std::string(result->get<0>()) };
+		}
+		if (search_strs.empty()) {
 			return;
 		}
 
 		std::vector<std::string_view> channels;
-		if (auto result = set.find<2>()) { //channel list
+		if (auto result = set.find<3>()) { //channel list
 			channels = result->get<0>();
 		}
-		else if (auto result = set.find<3>()) {//channel word
+		else if (auto result = set.find<4>()) {//channel word
 			channels = decltype(channels){result->get<0>()};
 		}
 		else {
@@ -594,13 +698,13 @@ void SaivBot::countCommandFunc(const IRCMessage & msg, std::string_view input_li
 
 		std::vector<std::string_view> users;
 		bool all_users = false;
-		if (auto result = set.find<4>()) { //user list
+		if (auto result = set.find<5>()) { //user list
 			users = result->get<0>();
 		}
-		else if (auto result = set.find<5>()) { //user word
+		else if (auto result = set.find<6>()) { //user word
 			users = decltype(users){result->get<0>()};
 		}
-		else if (set.find<6>()) {
+		else if (set.find<7>()) {
 			all_users = true;
 		}
 		else {
@@ -612,7 +716,7 @@ void SaivBot::countCommandFunc(const IRCMessage & msg, std::string_view input_li
 			TimeDetail::TimePoint(date::sys_days(current_date.year() / current_date.month() / 1)),
 			TimeDetail::TimePoint(date::sys_days((current_date.year() / current_date.month() / 1) + date::months(1)))
 		);
-		if (auto result = set.find<7>()) { //period
+		if (auto result = set.find<8>()) { //period
 			if (auto r2 = TimeDetail::parseTimePeriod(result->get<0>(), result->get<1>())) {
 				period = *r2;
 			}
@@ -622,16 +726,10 @@ void SaivBot::countCommandFunc(const IRCMessage & msg, std::string_view input_li
 			}
 		}
 
-		std::function<bool(char, char)> predicate;
-		if (set.find<8>()) { //predecate (-caseless)
-			predicate = [](char l, char r) {return std::tolower(l) == std::tolower(r); };
-		}
-		else {
-			predicate = std::equal_to<char>();
-		}
+		bool caseless = static_cast<bool>(set.find<9>()); //(-caseless)
 
 		LogService service;
-		if (auto r = set.find<9>()) { //service
+		if (auto r = set.find<10>()) { //service
 			auto s = r->get<0>();
 			if (caselessCompare(s, "gempir")) {
 				service = LogService::gempir_log;
@@ -639,6 +737,9 @@ void SaivBot::countCommandFunc(const IRCMessage & msg, std::string_view input_li
 			else if (caselessCompare(s, "overrustle")) {
 				service = LogService::overrustle_log;
 			}
+			else if (caselessCompare(s, "local") && m_chat_archiver) {
+				service = LogService::local_log;
+			}
 			else {
 				sendPRIVMSG(msg.getParams()[0], std::string(msg.getNick()).append(", invalid service NaM"));
 				return;
@@ -649,39 +750,91 @@ void SaivBot::countCommandFunc(const IRCMessage & msg, std::string_view input_li
 		}
 
 		bool regex = false;
-		if (auto r = set.find<10>()) {
+		if (auto r = set.find<11>()) {
 			regex = true;
 		}
+
+		bool word = static_cast<bool>(set.find<12>()); //(-word)
+
+		//rollups hold whole word caseless counts of single users in gempir logs
+		if (word && caseless && !regex && !all_users && service == LogService::gempir_log) {
+			if (auto counts = countFromRollups(channels, users, period, search_strs)) {
+				replyToIRCMessage(msg, formatCountReply(msg.getNick(), search_strs, *counts));
+				return;
+			}
+		}
 		
 		//set up log request
 		LogRequest log_request;
 		{
-			fillLogRequestTargetFields(log_request, service, all_users, period, channels, users);
+			bool filter_users = fillLogRequestTargetFields(log_request, service, all_users, period, channels, users);
+			if (log_request.targets.empty()) {
+				replyToIRCMessage(msg, std::string(msg.getNick()).append(", count: 0"));
+				return;
+			}
 			auto shared_data_ptr = std::make_shared<CountCallbackSharedData>();
 			shared_data_ptr->reference_count = log_request.targets.size();
-			if (!regex) {
-				shared_data_ptr->count_func = [search_str = std::move(search_str), predicate](std::string_view str) -> std::size_t {
-					auto searcher = std::default_searcher(search_str.begin(), search_str.end(), predicate);
-					return countTargetOccurrences(str.begin(), str.end(), searcher);
+			if (filter_users) {
+				shared_data_ptr->user_filter = createUserFilter(users);
+			}
+			if (word && !regex) {
+				shared_data_ptr->count_func = [targets = search_strs, caseless](std::string_view str, std::vector<std::size_t> & counts) {
+					TokenIndex::forEachToken(str, [&](std::string_view token) {
+						for (std::size_t i = 0; i < targets.size(); ++i) {
+							if (caseless ? caselessCompare(token, targets[i]) : token == targets[i]) ++counts[i];
+						}
+					});
+				};
+				if (caseless) {
+					shared_data_ptr->index_tokens = createIndexTokens(search_strs);
+				}
+			}
+			else if (!regex && search_strs.size() == 1) {
+				shared_data_ptr->count_func = [searcher = SubstringSearcher(search_strs.front(), caseless)](std::string_view str, std::vector<std::size_t> & counts) {
+					counts.front() += searcher.count(str);
+				};
+			}
+			else if (!regex) {
+				std::vector<std::string_view> patterns(search_strs.begin(), search_strs.end());
+				shared_data_ptr->count_func = [searcher = std::make_shared<const AhoCorasick>(patterns, caseless)](std::string_view str, std::vector<std::size_t> & counts) {
+					searcher->count(str, counts);
 				};
 			}
 			else {
-				auto regex_searcher = std::regex(search_str);
-				shared_data_ptr->count_func = [regex_searcher = std::move(regex_searcher)](std::string_view str) -> std::size_t {
-					return countTargetOccurrences(str, regex_searcher);
+				std::vector<std::shared_ptr<const Regex>> regex_searchers;
+				try {
+					for (auto & search_str : search_strs) {
+						regex_searchers.push_back(Regex::compile(search_str, caseless));
+					}
+				}
+				catch (std::runtime_error &) {
+					replyToIRCMessage(msg, std::string(msg.getNick()).append(", invalid regex NaM"));
+					return;
+				}
+				shared_data_ptr->count_func = [regex_searchers = std::move(regex_searchers)](std::string_view str, std::vector<std::size_t> & counts) {
+					for (std::size_t i = 0; i < regex_searchers.size(); ++i) {
+						counts[i] += regex_searchers[i]->count(str);
+					}
 				};
 			}
 			shared_data_ptr->period = period;
 			shared_data_ptr->irc_msg = msg;
-			shared_data_ptr->shared_count = 0;
+			shared_data_ptr->targets = std::move(search_strs);
+			shared_data_ptr->shared_count = std::vector<std::atomic<std::size_t>>(shared_data_ptr->targets.size());
 
-			log_request.callback = std::bind(
+			log_request.batch_callback = std::bind(
 				&SaivBot::countCommandCallback,
 				this,
 				std::placeholders::_1,
 				shared_data_ptr
 			);
 
+			log_request.target_done_handler = std::bind(
+				&SaivBot::countCommandTargetDoneHandler,
+				this,
+				shared_data_ptr
+			);
+
 			log_request.error_handler = std::bind(
 				&SaivBot::countCommandErrorHandler,
 				this,
@@ -689,7 +842,7 @@ void SaivBot::countCommandFunc(const IRCMessage & msg, std::string_view input_li
 			);
 
 		}
-		std::make_shared<LogDownloader>(m_ioc)->run(std::move(log_request));
+		std::make_shared<LogDownloader>(m_connection_pool)->run(std::move(log_request));
 	}
 }
 
@@ -698,6 +851,7 @@ void SaivBot::findCommandFunc(const IRCMessage & msg, std::string_view input_lin
 	if (isWhitelisted(msg.getNick())) {
 		using namespace OptionParser;
 		Parser parser(
+			Option<ListType>(m_command_containers[Commands::find_command].m_command),
 			Option<StringType>(m_command_containers[Commands::find_command].m_command),
 			Option<WordType>(m_command_containers[Commands::find_command].m_command),
 			Option<ListType>("-channel"),
@@ -708,27 +862,32 @@ void SaivBot::findCommandFunc(const IRCMessage & msg, std::string_view input_lin
 			Option<WordType, WordType>("-period"),
 			Option<>("-caseless"),
 			Option<WordType>("-service"),
-			Option<>("-regex")
+			Option<>("-regex"),
+			Option<>("-word")
 		);
 
 		auto set = parser.parse(input_line);
 
-		std::string search_str;
-		if (auto result = set.find<0>()) { //target string
-			search_str = result->get<0>();
+		std::vector<std::string> search_strs;
+		if (auto result = set.find<0>()) { //target list
+			auto list = result->get<0>();
+			search_strs.assign(list.begin(), list.end());
 		}
-		else if (auto result = set.find<1>()) { //target word
-			search_str = result->get<0>();
+		else if (auto result = set.find<1>()) { //target string
+			search_strs = { std::string(result->get<0>()) };
 		}
-		else {
+		else if (auto result = set.find<2>()) { //target word
+			search_strs = { std::string(result->get<0>()) };
+		}
+		if (search_strs.empty()) {
 			return;
 		}
 
 		std::vector<std::string_view> channels;
-		if (auto result = set.find<2>()) { //channel list
+		if (auto result = set.find<3>()) { //channel list
 			channels = result->get<0>();
 		}
-		else if (auto result = set.find<3>()) {//channel word
+		else if (auto result = set.find<4>()) {//channel word
 			channels = decltype(channels){result->get<0>()};
 		}
 		else {
@@ -740,13 +899,13 @@ void SaivBot::findCommandFunc(const IRCMessage & msg, std::string_view input_lin
 
 		std::vector<std::string_view> users;
 		bool all_users = false;
-		if (auto result = set.find<4>()) { //user list
+		if (auto result = set.find<5>()) { //user list
 			users = result->get<0>();
 		}
-		else if (auto result = set.find<5>()) { //user word
+		else if (auto result = set.find<6>()) { //user word
 			users = decltype(users){result->get<0>()};
 		}
-		else if (set.find<6>()) {
+		else if (set.find<7>()) {
 			all_users = true;
 		}
 		else {
@@ -758,7 +917,7 @@ void SaivBot::findCommandFunc(const IRCMessage & msg, std::string_view input_lin
 			TimeDetail::TimePoint(date::sys_days(current_date.year() / current_date.month() / 1)),
 			TimeDetail::TimePoint(date::sys_days((current_date.year() / current_date.month() / 1) + date::months(1)))
 		);
-		if (auto result = set.find<7>()) { //period
+		if (auto result = set.find<8>()) { //period
 			if (auto r2 = TimeDetail::parseTimePeriod(result->get<0>(), result->get<1>())) {
 				period = *r2;
 			}
@@ -768,16 +927,10 @@ void SaivBot::findCommandFunc(const IRCMessage & msg, std::string_view input_lin
 			}
 		}
 
-		std::function<bool(char, char)> predicate;
-		if (set.find<8>()) { //predecate (-caseless)
-			predicate = [](char l, char r) {return std::tolower(l) == std::tolower(r); };
-		}
-		else {
-			predicate = std::equal_to<char>();
-		}
+		bool caseless = static_cast<bool>(set.find<9>()); //(-caseless)
 
 		LogService service;
-		if (auto r = set.find<9>()) { //service
+		if (auto r = set.find<10>()) { //service
 			auto s = r->get<0>();
 			if (caselessCompare(s, "gempir")) {
 				service = LogService::gempir_log;
@@ -785,6 +938,9 @@ void SaivBot::findCommandFunc(const IRCMessage & msg, std::string_view input_lin
 			else if (caselessCompare(s, "overrustle")) {
 				service = LogService::overrustle_log;
 			}
+			else if (caselessCompare(s, "local") && m_chat_archiver) {
+				service = LogService::local_log;
+			}
 			else {
 				sendPRIVMSG(msg.getParams()[0], std::string(msg.getNick()).append(", invalid service NaM"));
 				return;
@@ -795,64 +951,101 @@ void SaivBot::findCommandFunc(const IRCMessage & msg, std::string_view input_lin
 		}
 
 		bool regex = false;
-		if (auto r = set.find<10>()) {
+		if (auto r = set.find<11>()) {
 			regex = true;
 		}
 
+		bool word = static_cast<bool>(set.find<12>()); //(-word)
+
 		//set up log request
 		LogRequest log_request;
 		{
-			fillLogRequestTargetFields(log_request, service, all_users, period, channels, users);
+			bool filter_users = fillLogRequestTargetFields(log_request, service, all_users, period, channels, users);
+			if (log_request.targets.empty()) {
+				replyToIRCMessage(msg, std::string(msg.getNick()).append(", no hit NaM"));
+				return;
+			}
 			auto shared_data_ptr = std::make_shared<FindCallbackSharedData>();
 			shared_data_ptr->reference_count = log_request.targets.size();
-			if (!regex) {
-				shared_data_ptr->find_func = [search_str = std::move(search_str), predicate](std::string_view str)->std::size_t {
-					auto searcher = std::default_searcher(search_str.begin(), search_str.end(), predicate);
-					return std::search(str.begin(), str.end(), searcher) != str.end();
+			if (filter_users) {
+				shared_data_ptr->user_filter = createUserFilter(users);
+			}
+			if (word && !regex) {
+				shared_data_ptr->find_func = [targets = search_strs, caseless](std::string_view str) {
+					bool found = false;
+					TokenIndex::forEachToken(str, [&](std::string_view token) {
+						for (auto & target : targets) {
+							found = found || (caseless ? caselessCompare(token, target) : token == target);
+						}
+					});
+					return found;
 				};
+				if (caseless) {
+					shared_data_ptr->index_tokens = createIndexTokens(search_strs);
+				}
 			}
-			else {
-				auto regex_searcher = std::regex(search_str);	
-				shared_data_ptr->find_func = [regex_searcher = std::move(regex_searcher)](std::string_view str)->std::size_t {
-					return std::regex_match(str.begin(), str.end(), regex_searcher);
+			else if (!regex && search_strs.size() == 1) {
+				shared_data_ptr->find_func = [searcher = SubstringSearcher(search_strs.front(), caseless)](std::string_view str) {
+					return searcher.contains(str);
 				};
 			}
-			shared_data_ptr->dump_func = [](FindCallbackSharedData::SharedLinesFound & lines) {
-				std::sort(
-					lines.begin(),
-					lines.end(),
-					[](auto & a, auto & b) {return std::get<1>(a).getTime() < std::get<1>(b).getTime(); }
-				);
-				std::stringstream ss;
-				for (auto & tuple : lines) {
-					using namespace date;
-					auto & channel_name = *std::get<0>(tuple);
-					auto & line = std::get<1>(tuple);
-					ss << line.getTime() << " #" << channel_name << " " << line.getNameView() << ": " << line.getMessageView() << "\n";
+			else if (!regex) {
+				std::vector<std::string_view> patterns(search_strs.begin(), search_strs.end());
+				shared_data_ptr->find_func = [searcher = std::make_shared<const AhoCorasick>(patterns, caseless)](std::string_view str) {
+					return searcher->containsAny(str);
+				};
+			}
+			else {
+				std::vector<std::shared_ptr<const Regex>> regex_searchers;
+				try {
+					for (auto & search_str : search_strs) {
+						regex_searchers.push_back(Regex::compile(search_str, caseless));
+					}
 				}
-				return ss.str();
+				catch (std::runtime_error &) {
+					replyToIRCMessage(msg, std::string(msg.getNick()).append(", invalid regex NaM"));
+					return;
+				}
+				shared_data_ptr->find_func = [regex_searchers = std::move(regex_searchers)](std::string_view str) {
+					for (auto & regex_searcher : regex_searchers) {
+						if (regex_searcher->fullMatch(str)) return true;
+					}
+					return false;
+				};
+			}
+			shared_data_ptr->dump_func = [](const FindCallbackSharedData::LineRef & line, std::string & buffer) {
+				auto & [log, i] = line;
+				buffer
+					.append(date::format("%F %T", log->getTime(i)))
+					.append(" #").append(log->getChannelName())
+					.append(" ").append(log->getName(i))
+					.append(": ").append(log->getMessage(i))
+					.append("\n");
 			};
 
 			shared_data_ptr->period = period;
-			shared_data_ptr->irc_msg = msg;		
-			for (auto & channel : channels) {	
-				shared_data_ptr->channels.emplace(channel);
-			}
+			shared_data_ptr->irc_msg = msg;
 
-			log_request.callback = std::bind(
+			log_request.batch_callback = std::bind(
 				&SaivBot::findCommandCallback,
 				this,
 				std::placeholders::_1,
 				shared_data_ptr
 			);
 
+			log_request.target_done_handler = std::bind(
+				&SaivBot::findCommandTargetDoneHandler,
+				this,
+				shared_data_ptr
+			);
+
 			log_request.error_handler = std::bind(
 				&SaivBot::findCommandErrorHandler,
 				this,
 				shared_data_ptr
 			);
 		}
-		std::make_shared<LogDownloader>(m_ioc)->run(std::move(log_request));
+		std::make_shared<LogDownloader>(m_connection_pool)->run(std::move(log_request));
 	}
 }
 
@@ -866,33 +1059,28 @@ void SaivBot::clipCommandFunc(const IRCMessage & msg, std::string_view input_lin
 		std::string channel(msg.getParams()[0]);
 		auto it = m_channels.find(channel);
 		if (it != m_channels.end()) {
-			IRCMessageBuffer & msg_buffer = *std::get<0>(it->second);
+			IRCMessageBuffer & msg_buffer = it->second->m_buffer;
 
 			if (auto r = set.find<0>()) {
 				std::size_t line_count = r->get<0>();
 				if (line_count > 0) {
-					msg_buffer.accessLinesFromNow(
-						line_count,
-						[&](const IRCMessageBuffer::LinesFromNowVecType & lines)
-					{
-						std::stringstream ss;
-						for (const IRCMessage & irc_msg : lines) {
-							using namespace date;
-							ss << irc_msg.getTime() << " " << irc_msg.getNick() << ": " << irc_msg.getBody() << "\n";
-						}
-						std::make_shared<DankHttp::NuulsUploader>(m_ioc)->run(
-							std::bind(
-								&SaivBot::clipCommandCallback,
-								this,
-								std::placeholders::_1,
-								std::make_shared<IRCMessage>(msg)
-							),
-							ss.str(),
-							"i.nuuls.com",
-							"443",
-							"/upload"
-						);
+					//copy never blocks the channel strand pushing new lines
+					std::stringstream ss;
+					for (const IRCMessageBuffer::Line & line : msg_buffer.copyLinesFromNow(line_count)) {
+						using namespace date;
+						ss << line.time << " " << line.nick << ": " << line.body << "\n";
 					}
+					std::make_shared<DankHttp::NuulsUploader>(m_connection_pool)->run(
+						std::bind(
+							&SaivBot::clipCommandCallback,
+							this,
+							std::placeholders::_1,
+							std::make_shared<IRCMessage>(msg)
+						),
+						ss.str(),
+						"i.nuuls.com",
+						"443",
+						"/upload"
 					);
 				}
 			}
@@ -1084,10 +1272,14 @@ void SaivBot::nuulsServerReply(const std::string & str, const IRCMessage & msg)
 
 std::vector<date::year_month> SaivBot::periodToYearMonths(const TimeDetail::TimePeriod & period)
 {
-	std::vector<date::year_month> year_months;	
+	std::vector<date::year_month> year_months;
+	if (period.begin() >= period.end()) {
+		return year_months;
+	}
 	date::year_month_day ymd = date::floor<date::days>(period.begin());
 	date::year_month begin_ym(ymd.year(), ymd.month());
-	ymd = date::floor<date::days>(period.end());
+	//last instant inside period
+	ymd = date::floor<date::days>(period.end() - TimeDetail::TimePoint::duration(1));
 	date::year_month end_ym(ymd.year(), ymd.month());
 	end_ym += date::months(1);
 	while (begin_ym < end_ym) {
@@ -1100,28 +1292,22 @@ std::vector<date::year_month> SaivBot::periodToYearMonths(const TimeDetail::Time
 std::vector<date::year_month_day> SaivBot::periodToDates(const TimeDetail::TimePeriod & period)
 {
 	std::vector<date::year_month_day> dates;
-	date::year_month_day begin = date::floor<date::days>(period.begin());
-	date::year_month_day end = date::floor<date::days>(period.end());
-	end = date::sys_days{ end } + date::days(1);
+	if (period.begin() >= period.end()) {
+		return dates;
+	}
+	date::sys_days begin = date::floor<date::days>(period.begin());
+	date::sys_days end = date::ceil<date::days>(period.end());
 	while (begin < end) {
 		dates.push_back(begin);
-		begin = date::sys_days{ begin } + date::days(1);
+		begin += date::days(1);
 	}
 	return dates;
 }
 
-std::size_t countTargetOccurrences(std::string_view str, const std::regex & regex)
+bool SaivBot::preferChannelLogs(std::size_t users, std::size_t months, std::size_t days)
 {
-	std::match_results<std::string_view::const_iterator> m;
-	std::size_t count = 0;
-	auto begin = str.cbegin();
-	auto end = str.cend();
-	while (std::regex_search(begin, end, m, regex)) {
-		++count;
-		begin = m.suffix().first;
-	}
-
-	return count;
+	return static_cast<std::uintmax_t>(users) * months * m_estimated_user_month_log_bytes
+		> static_cast<std::uintmax_t>(days) * m_estimated_channel_day_log_bytes;
 }
 
 bool caselessCompare(std::string_view str1, std::string_view str2)
@@ -1136,3 +1322,20 @@ bool caselessCompare(std::string_view str1, std::string_view str2)
 	}
 	return true;
 }
+
+std::function<bool(std::string_view)> createUserFilter(const std::vector<std::string_view> & users)
+{
+	std::vector<std::string> names(users.begin(), users.end());
+	return [names = std::move(names)](std::string_view name) {
+		return std::any_of(names.begin(), names.end(), [name](const std::string & user) {return caselessCompare(name, user); });
+	};
+}
+
+std::vector<std::string> createIndexTokens(const std::vector<std::string> & targets)
+{
+	std::vector<std::string> tokens(targets.size());
+	for (std::size_t i = 0; i < targets.size(); ++i) {
+		TokenIndex::lowerToken(targets[i], tokens[i]);
+	}
+	return tokens;
+}
@@ -0,0 +1,234 @@
+//SubstringSearcher.cpp
+
+#include "../include/SubstringSearcher.hpp"
+
+//C++
+#include <array>
+#include <cstring>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SubstringSearcher_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define SubstringSearcher_TARGET_AVX2
+#else
+#define SubstringSearcher_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace
+{
+	constexpr std::array<unsigned char, 256> createFoldTable()
+	{
+		std::array<unsigned char, 256> table{};
+		for (std::size_t i = 0; i < table.size(); ++i) {
+			table[i] = static_cast<unsigned char>((i >= 'A' && i <= 'Z') ? i + ('a' - 'A') : i);
+		}
+		return table;
+	}
+
+	constexpr std::array<unsigned char, 256> fold_table = createFoldTable();
+
+	inline unsigned char fold(char c)
+	{
+		return fold_table[static_cast<unsigned char>(c)];
+	}
+
+	/*
+	Compare needle[1, size - 1) against candidate, first and last byte are already known to match.
+	*/
+	inline bool equalMiddle(const char * candidate, std::string_view needle, bool caseless)
+	{
+		if (needle.size() <= 2) return true;
+		if (!caseless) {
+			return std::memcmp(candidate + 1, needle.data() + 1, needle.size() - 2) == 0;
+		}
+		for (std::size_t i = 1; i < needle.size() - 1; ++i) {
+			if (fold(candidate[i]) != static_cast<unsigned char>(needle[i])) return false;
+		}
+		return true;
+	}
+
+	std::size_t findScalar(std::string_view haystack, std::size_t pos, std::string_view needle, bool caseless)
+	{
+		const std::size_t k = needle.size();
+		if (pos > haystack.size() || haystack.size() - pos < k) return SubstringSearcher::npos;
+		const char * s = haystack.data();
+		const std::size_t last = haystack.size() - k;
+		if (!caseless) {
+			for (std::size_t i = pos; i <= last; ++i) {
+				const void * p = std::memchr(s + i, needle[0], last - i + 1);
+				if (!p) break;
+				i = static_cast<const char*>(p) - s;
+				if (s[i + k - 1] == needle[k - 1] && equalMiddle(s + i, needle, false)) return i;
+			}
+			return SubstringSearcher::npos;
+		}
+		const unsigned char first_byte = static_cast<unsigned char>(needle[0]);
+		const unsigned char last_byte = static_cast<unsigned char>(needle[k - 1]);
+		for (std::size_t i = pos; i <= last; ++i) {
+			if (fold(s[i]) == first_byte && fold(s[i + k - 1]) == last_byte && equalMiddle(s + i, needle, true)) return i;
+		}
+		return SubstringSearcher::npos;
+	}
+
+#ifdef SubstringSearcher_X86
+	inline unsigned countTrailingZeros(std::uint32_t mask)
+	{
+#if defined(_MSC_VER)
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return static_cast<unsigned>(index);
+#else
+		return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+	}
+
+	/*
+	'A'..'Z' is moved to the bottom of the signed range so one compare finds upper case letters.
+	*/
+	inline __m128i foldSse2(__m128i v)
+	{
+		const __m128i shifted = _mm_add_epi8(v, _mm_set1_epi8(static_cast<char>(128 - 'A')));
+		const __m128i upper = _mm_cmplt_epi8(shifted, _mm_set1_epi8(static_cast<char>(-128 + 26)));
+		return _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+	}
+
+	std::size_t findSse2(std::string_view haystack, std::size_t pos, std::string_view needle, bool caseless)
+	{
+		const std::size_t k = needle.size();
+		const std::size_t n = haystack.size();
+		const char * s = haystack.data();
+		const __m128i first = _mm_set1_epi8(needle[0]);
+		const __m128i last = _mm_set1_epi8(needle[k - 1]);
+		std::size_t i = pos;
+		for (; i + k - 1 + 16 <= n; i += 16) {
+			__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+			__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i + k - 1));
+			if (caseless) {
+				a = foldSse2(a);
+				b = foldSse2(b);
+			}
+			std::uint32_t mask = static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last))));
+			while (mask) {
+				const unsigned bit = countTrailingZeros(mask);
+				if (equalMiddle(s + i + bit, needle, caseless)) return i + bit;
+				mask &= mask - 1;
+			}
+		}
+		return findScalar(haystack, i, needle, caseless);
+	}
+
+	SubstringSearcher_TARGET_AVX2
+	inline __m256i foldAvx2(__m256i v)
+	{
+		const __m256i shifted = _mm256_add_epi8(v, _mm256_set1_epi8(static_cast<char>(128 - 'A')));
+		const __m256i upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(-128 + 26)), shifted);
+		return _mm256_or_si256(v, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+	}
+
+	SubstringSearcher_TARGET_AVX2
+	std::size_t findAvx2(std::string_view haystack, std::size_t pos, std::string_view needle, bool caseless)
+	{
+		const std::size_t k = needle.size();
+		const std::size_t n = haystack.size();
+		const char * s = haystack.data();
+		const __m256i first = _mm256_set1_epi8(needle[0]);
+		const __m256i last = _mm256_set1_epi8(needle[k - 1]);
+		std::size_t i = pos;
+		for (; i + k - 1 + 32 <= n; i += 32) {
+			__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i));
+			__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i + k - 1));
+			if (caseless) {
+				a = foldAvx2(a);
+				b = foldAvx2(b);
+			}
+			std::uint32_t mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last))));
+			while (mask) {
+				const unsigned bit = countTrailingZeros(mask);
+				if (equalMiddle(s + i + bit, needle, caseless)) return i + bit;
+				mask &= mask - 1;
+			}
+		}
+		return findSse2(haystack, i, needle, caseless);
+	}
+
+	bool cpuHasAvx2()
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7) return false;
+		__cpuid(info, 1);
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		if (!osxsave || (_xgetbv(0) & 0x6) != 0x6) return false;
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+#endif
+}
+
+SubstringSearcher::SubstringSearcher(std::string_view needle, bool caseless) :
+	m_needle(needle),
+	m_caseless(caseless),
+	m_kernel(getKernel().func)
+{
+	if (m_caseless) {
+		for (auto & c : m_needle) {
+			c = static_cast<char>(fold(c));
+		}
+	}
+}
+
+std::size_t SubstringSearcher::find(std::string_view haystack, std::size_t pos) const
+{
+	if (m_needle.empty()) {
+		return pos <= haystack.size() ? pos : npos;
+	}
+	if (pos > haystack.size() || haystack.size() - pos < m_needle.size()) {
+		return npos;
+	}
+	return m_kernel(haystack, pos, m_needle, m_caseless);
+}
+
+bool SubstringSearcher::contains(std::string_view haystack) const
+{
+	return find(haystack) != npos;
+}
+
+std::size_t SubstringSearcher::count(std::string_view haystack) const
+{
+	if (m_needle.empty()) return 0;
+	std::size_t count = 0;
+	std::size_t pos = 0;
+	while ((pos = find(haystack, pos)) != npos) {
+		++count;
+		++pos;
+	}
+	return count;
+}
+
+const char * SubstringSearcher::getKernelName()
+{
+	return getKernel().name;
+}
+
+const SubstringSearcher::Kernel & SubstringSearcher::getKernel()
+{
+	static const Kernel kernel = []() -> Kernel {
+#ifdef SubstringSearcher_X86
+		if (cpuHasAvx2()) {
+			return Kernel{ findAvx2, "avx2" };
+		}
+		return Kernel{ findSse2, "sse2" };
+#else
+		return Kernel{ findScalar, "scalar" };
+#endif
+	}();
+	return kernel;
+}
@@ -0,0 +1,161 @@
+//TokenIndex.cpp
+
+#include "../include/TokenIndex.hpp"
+
+namespace
+{
+	const char index_magic[8] = { 'S', 'B', 'T', 'O', 'K', 'I', 'D', 'X' };
+
+	std::uint64_t align8(std::uint64_t n)
+	{
+		return (n + 7) & ~std::uint64_t(7);
+	}
+
+	void writePadding(std::ostream & stream, std::uint64_t n)
+	{
+		const char zero[8] = {};
+		stream.write(zero, align8(n) - n);
+	}
+
+	void writeVarint(std::string & out, std::uint64_t n)
+	{
+		while (n >= 0x80) {
+			out.push_back(static_cast<char>((n & 0x7f) | 0x80));
+			n >>= 7;
+		}
+		out.push_back(static_cast<char>(n));
+	}
+}
+
+std::optional<TokenIndex> TokenIndex::view(const char * data, std::uint64_t size)
+{
+	if (size < sizeof(Header)) return std::nullopt;
+	const Header * header = reinterpret_cast<const Header*>(data);
+	if (std::memcmp(header->magic, index_magic, sizeof(header->magic)) != 0) return std::nullopt;
+
+	std::uint64_t token_offsets = sizeof(Header);
+	std::uint64_t posting_offsets = token_offsets + (header->token_count + 1) * sizeof(std::uint64_t);
+	std::uint64_t posting_counts = posting_offsets + (header->token_count + 1) * sizeof(std::uint64_t);
+	std::uint64_t token_blob = posting_counts + header->token_count * sizeof(std::uint64_t);
+	std::uint64_t posting_blob = align8(token_blob + header->token_blob_size);
+	std::uint64_t end = posting_blob + header->posting_blob_size;
+	if (header->token_count > size / sizeof(std::uint64_t) || end > size) return std::nullopt;
+
+	TokenIndex index;
+	index.m_header = header;
+	index.m_token_offsets = reinterpret_cast<const std::uint64_t*>(data + token_offsets);
+	index.m_posting_offsets = reinterpret_cast<const std::uint64_t*>(data + posting_offsets);
+	index.m_posting_counts = reinterpret_cast<const std::uint64_t*>(data + posting_counts);
+	index.m_token_blob = data + token_blob;
+	index.m_posting_blob = reinterpret_cast<const std::uint8_t*>(data + posting_blob);
+
+	//offsets must stay inside their blobs
+	if (index.m_token_offsets[header->token_count] != header->token_blob_size ||
+		index.m_posting_offsets[header->token_count] != header->posting_blob_size) {
+		return std::nullopt;
+	}
+	return index;
+}
+
+std::uint64_t TokenIndex::getNumberOfLines() const
+{
+	return m_header->line_count;
+}
+
+std::optional<TokenIndex::Postings> TokenIndex::find(std::string_view token) const
+{
+	//binary search sorted tokens
+	std::uint64_t first = 0;
+	std::uint64_t count = m_header->token_count;
+	while (count > 0) {
+		std::uint64_t step = count / 2;
+		if (getToken(first + step) < token) {
+			first += step + 1;
+			count -= step + 1;
+		}
+		else {
+			count = step;
+		}
+	}
+	if (first == m_header->token_count || getToken(first) != token) {
+		return std::nullopt;
+	}
+	return Postings(
+		m_posting_blob + m_posting_offsets[first],
+		m_posting_blob + m_posting_offsets[first + 1],
+		m_posting_counts[first]
+	);
+}
+
+void TokenIndex::lowerToken(std::string_view token, std::string & out)
+{
+	out.assign(token.data(), token.size());
+	for (char & c : out) {
+		if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+	}
+}
+
+bool TokenIndex::isToken(std::string_view str)
+{
+	return !str.empty() && std::none_of(str.begin(), str.end(), isSpace);
+}
+
+std::string_view TokenIndex::getToken(std::uint64_t i) const
+{
+	return std::string_view(m_token_blob + m_token_offsets[i], m_token_offsets[i + 1] - m_token_offsets[i]);
+}
+
+void TokenIndex::Builder::append(const Log & log)
+{
+	const std::size_t line_count = log.getNumberOfLines();
+	for (std::size_t i = 0; i < line_count; ++i) {
+		std::uint64_t line_id = m_line_count + i;
+		forEachToken(log.getMessage(i), [&](std::string_view token) {
+			lowerToken(token, m_token);
+			auto & list = m_postings[m_token];
+			writeVarint(list.bytes, line_id - list.last);
+			list.last = line_id;
+			++list.count;
+		});
+	}
+	m_line_count += line_count;
+}
+
+bool TokenIndex::Builder::write(std::ostream & stream) const
+{
+	std::vector<const std::pair<const std::string, PostingList>*> sorted;
+	sorted.reserve(m_postings.size());
+	for (auto & pair : m_postings) {
+		sorted.push_back(&pair);
+	}
+	std::sort(sorted.begin(), sorted.end(), [](auto a, auto b) {return a->first < b->first; });
+
+	std::vector<std::uint64_t> token_offsets{ 0 };
+	std::vector<std::uint64_t> posting_offsets{ 0 };
+	std::vector<std::uint64_t> posting_counts;
+	for (auto pair : sorted) {
+		token_offsets.push_back(token_offsets.back() + pair->first.size());
+		posting_offsets.push_back(posting_offsets.back() + pair->second.bytes.size());
+		posting_counts.push_back(pair->second.count);
+	}
+
+	Header header;
+	std::memcpy(header.magic, index_magic, sizeof(header.magic));
+	header.line_count = m_line_count;
+	header.token_count = sorted.size();
+	header.token_blob_size = token_offsets.back();
+	header.posting_blob_size = posting_offsets.back();
+
+	stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	stream.write(reinterpret_cast<const char*>(token_offsets.data()), token_offsets.size() * sizeof(std::uint64_t));
+	stream.write(reinterpret_cast<const char*>(posting_offsets.data()), posting_offsets.size() * sizeof(std::uint64_t));
+	stream.write(reinterpret_cast<const char*>(posting_counts.data()), posting_counts.size() * sizeof(std::uint64_t));
+	for (auto pair : sorted) {
+		stream.write(pair->first.data(), pair->first.size());
+	}
+	writePadding(stream, header.token_blob_size);
+	for (auto pair : sorted) {
+		stream.write(pair->second.bytes.data(), pair->second.bytes.size());
+	}
+	return !stream.fail();
+}